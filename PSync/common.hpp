@@ -0,0 +1,93 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014-2019,  The University of Memphis
+ *
+ * This file is part of PSync.
+ * See AUTHORS.md for complete list of PSync authors and contributors.
+ *
+ * PSync is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU Lesser General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * PSync is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along with
+ * PSync, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PSYNC_COMMON_HPP
+#define PSYNC_COMMON_HPP
+
+#include "PSync/detail/config.hpp"
+
+#include <cstdint>
+
+namespace psync {
+
+/**
+ * @brief Compression applied to an encoded IBF
+ *
+ * The scheme is sent along with the IBF, so every node can decode
+ * IBFs compressed with any scheme supported by its build,
+ * whichever scheme it uses itself.
+ */
+enum class CompressionScheme : uint8_t {
+  NONE  = 0,
+  ZLIB  = 1,
+  GZIP  = 2,
+  BZIP2 = 3, ///< only if Boost.Iostreams is built with bzip2 support
+  LZMA  = 4, ///< only if Boost.Iostreams is built with lzma support
+  ZSTD  = 5, ///< only if Boost.Iostreams is built with zstd support
+  // Values must stay below 8, see IBLT::initialize
+  DEFAULT = ZLIB
+};
+
+/**
+ * @brief Width of the keys, i.e. the hashes of prefix/seq, stored in an IBF
+ *
+ * All nodes of a sync group must use the same key width.  64-bit keys make
+ * hash collisions between prefix/seq pairs negligible even for millions of pairs.
+ */
+enum class KeyWidth : uint8_t {
+  BITS_32 = 32,
+  BITS_64 = 64,
+  DEFAULT = BITS_32
+};
+
+/**
+ * @brief Hash function family of the keys of an IBF and of the cells they are added to
+ *
+ * It hashes the prefix/seq pairs into keys as well as the keys into cells and check sums,
+ * so, like the key width, all nodes of a sync group must use the same family.
+ */
+enum class HashFamily : uint8_t {
+  MURMUR3 = 0, ///< murmurHash3, 32-bit (x64 variant for 64-bit keys)
+  WYHASH  = 1, ///< 64-bit wyhash, faster for names and 64-bit keys
+  DEFAULT = MURMUR3
+};
+
+/**
+ * @brief Geometry of an IBF
+ *
+ * More cells per expected entry and more hash functions make decoding more reliable,
+ * at the cost of larger sync interests and more work per update.  All nodes of a sync
+ * group must use the same number of hash functions, check seed and hash family; IBFs
+ * that do not use the defaults carry them, so a mismatch is detected rather than misdecoded.
+ */
+struct IbltParameters
+{
+  /// number of cells every key is added to, one per hash function, at most 8
+  uint8_t nHash = 3;
+  /// number of cells per expected entry
+  double overprovisionFactor = 1.5;
+  /// seed of the hash that tells whether a cell holds a single key, at least nHash
+  uint32_t checkSeed = 11;
+  /// hash of the prefix/seq pairs, of the keys to their cells and of the check sums
+  HashFamily hashFamily = HashFamily::DEFAULT;
+};
+
+} // namespace psync
+
+#endif // PSYNC_COMMON_HPP
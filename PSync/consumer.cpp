@@ -18,6 +18,7 @@
  **/
 
 #include "PSync/consumer.hpp"
+#include "PSync/detail/iblt.hpp"
 #include "PSync/detail/state.hpp"
 
 #include <ndn-cxx/util/logger.hpp>
@@ -36,7 +37,8 @@ Consumer::Consumer(const ndn::Name& syncPrefix,
                    unsigned int count,
                    double false_positive = 0.001,
                    ndn::time::milliseconds helloInterestLifetime,
-                   ndn::time::milliseconds syncInterestLifetime)
+                   ndn::time::milliseconds syncInterestLifetime,
+                   bool useIbltDigest)
  : m_face(face)
  , m_scheduler(m_face.getIoService())
  , m_syncPrefix(syncPrefix)
@@ -48,6 +50,7 @@ Consumer::Consumer(const ndn::Name& syncPrefix,
  , m_bloomFilter(count, false_positive)
  , m_helloInterestLifetime(helloInterestLifetime)
  , m_syncInterestLifetime(syncInterestLifetime)
+ , m_useIbltDigest(useIbltDigest)
  , m_rng(ndn::random::getRandomNumberEngine())
  , m_rangeUniformRandom(100, 500)
 {
@@ -166,8 +169,14 @@ Consumer::sendSyncInterest()
   // Append subscription list
   m_bloomFilter.appendToName(syncInterestName);
 
-  // Append IBF received in hello/sync data
-  syncInterestName.append(m_iblt);
+  // Append IBF received in hello/sync data, or only its digest
+  auto digest = IBLT::extractDigest(m_iblt.get(0));
+  if (m_useIbltDigest && digest) {
+    syncInterestName.append(IBLT::makeDigestReference(*digest));
+  }
+  else {
+    syncInterestName.append(m_iblt);
+  }
 
   ndn::Interest syncInterest(syncInterestName);
 
@@ -74,6 +74,9 @@ public:
    * @param false_positive bloom filter false positive probability
    * @param helloInterestLifetime lifetime of hello interest
    * @param syncInterestLifetime lifetime of sync interest
+   * @param useIbltDigest whether to send only the digest of the producer's IBF in sync
+   *        interests instead of the whole IBF, which the producer rebuilds from its
+   *        recent history (a Nack leads to hello again if it cannot)
    */
   Consumer(const ndn::Name& syncPrefix,
            ndn::Face& face,
@@ -82,7 +85,8 @@ public:
            unsigned int count,
            double false_positive,
            ndn::time::milliseconds helloInterestLifetime = HELLO_INTEREST_LIFETIME,
-           ndn::time::milliseconds syncInterestLifetime = SYNC_INTEREST_LIFETIME);
+           ndn::time::milliseconds syncInterestLifetime = SYNC_INTEREST_LIFETIME,
+           bool useIbltDigest = false);
 
   /**
    * @brief send hello interest /<sync-prefix>/hello/
@@ -188,6 +192,7 @@ PSYNC_PUBLIC_WITH_TESTS_ELSE_PRIVATE:
 
   ndn::time::milliseconds m_helloInterestLifetime;
   ndn::time::milliseconds m_syncInterestLifetime;
+  bool m_useIbltDigest;
 
   // Store sequence number for the prefix.
   std::map<ndn::Name, uint64_t> m_prefixes;
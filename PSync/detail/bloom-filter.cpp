@@ -62,6 +62,11 @@ NDN_LOG_INIT(psync.BloomFilter);
 namespace psync {
 
 static const std::size_t bits_per_char = 0x08;
+
+// Salted hashes of a key computed in one pass over the key, enough for the
+// number of hashes of false positive probabilities down to about 1e-4
+static const std::size_t hashes_per_pass = 16;
+
 static const unsigned char bit_mask[bits_per_char] = {
   0x01,  //00000001
   0x02,  //00000010
@@ -208,10 +213,17 @@ BloomFilter::insert(const std::string& key)
 {
   std::size_t bit_index = 0;
   std::size_t bit = 0;
-  for (std::size_t i = 0; i < salt_.size(); ++i)
+  bloom_type hashes[hashes_per_pass];
+  for (std::size_t first = 0; first < salt_.size(); first += hashes_per_pass)
   {
-     compute_indices(murmurHash3(salt_[i], key), bit_index, bit);
-     bit_table_[bit_index/bits_per_char] |= bit_mask[bit];
+    std::size_t n = std::min(hashes_per_pass, salt_.size() - first);
+    murmurHash3(salt_.data() + first, n, reinterpret_cast<const uint8_t*>(key.data()),
+                key.size(), hashes);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      compute_indices(hashes[i], bit_index, bit);
+      bit_table_[bit_index/bits_per_char] |= bit_mask[bit];
+    }
   }
   ++inserted_element_count_;
 }
@@ -221,12 +233,20 @@ BloomFilter::contains(const std::string& key) const
 {
   std::size_t bit_index = 0;
   std::size_t bit = 0;
+  bloom_type hashes[hashes_per_pass];
 
-  for (std::size_t i = 0; i < salt_.size(); ++i)
+  for (std::size_t first = 0; first < salt_.size(); first += hashes_per_pass)
   {
-    compute_indices(murmurHash3(salt_[i], key), bit_index, bit);
-    if ((bit_table_[bit_index/bits_per_char] & bit_mask[bit]) != bit_mask[bit]) {
-      return false;
+    std::size_t n = std::min(hashes_per_pass, salt_.size() - first);
+    murmurHash3(salt_.data() + first, n, reinterpret_cast<const uint8_t*>(key.data()),
+                key.size(), hashes);
+
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      compute_indices(hashes[i], bit_index, bit);
+      if ((bit_table_[bit_index/bits_per_char] & bit_mask[bit]) != bit_mask[bit]) {
+        return false;
+      }
     }
   }
 
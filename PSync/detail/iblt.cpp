@@ -46,23 +46,246 @@
 #include "PSync/detail/iblt.hpp"
 #include "PSync/detail/util.hpp"
 
-#include <boost/iostreams/device/array.hpp>
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/zlib.hpp>
-#include <boost/iostreams/copy.hpp>
+#include <algorithm>
+#include <limits>
 
-namespace psync {
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
-namespace bio = boost::iostreams;
+namespace psync {
 
 const size_t N_HASH(3);
 const size_t N_HASHCHECK(11);
 
+// Table encodings, stored in bits 4 and 5 of the first byte of an encoded IBLT.
+// 0 is not used: the fixed table is only sent by legacy peers, without a header.
+enum : uint8_t {
+  ENCODING_SPARSE = 1,
+  ENCODING_SPARSE_64 = 2, // sparse with 64-bit keys
+  ENCODING_PACKED = 3,    // key width is in the table
+};
+
+// Largest varint of a 64-bit value
+const size_t MAX_VARINT_SIZE = 10;
+
+// Flags in the header byte of an encoded IBLT: the 8-byte digest follows the header,
+// then the number of hash functions (1 byte), the check seed (4 bytes) and the hash family
+// (1 byte)
+const uint8_t HAS_DIGEST = 0x80;
+const uint8_t HAS_PARAMETERS = 0x40;
+
+// Sparse tables are mostly hash sums; below this size compression does not pay for its overhead
+const size_t MIN_COMPRESS_SIZE = 512;
+
+// IBFs of PSync versions without the header byte are a bare zlib stream of the fixed table
+// (see decodeLegacyTable).  It starts with the zlib header: CMF 0x78 (deflate with a 32K
+// window), which is never a header byte of ours since there is no compression scheme 8,
+// and FLG, which makes the two bytes a multiple of 31 and sets no preset dictionary.
+static bool
+isLegacyEncoding(const ndn::name::Component& ibltName)
+{
+  const uint8_t* value = ibltName.value_begin();
+  return ibltName.value_size() >= 2 && value[0] == 0x78 && !(value[1] & 0x20) &&
+         ((value[0] << 8) | value[1]) % 31 == 0;
+}
+
+static void
+appendVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+static size_t
+getVarintSize(uint64_t value)
+{
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+static bool
+readVarint(const uint8_t*& pos, const uint8_t* end, uint64_t& value)
+{
+  value = 0;
+  for (int shift = 0; pos != end && shift < 64; shift += 7) {
+    uint8_t byte = *pos++;
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void
+appendUint32(std::vector<uint8_t>& out, uint32_t value)
+{
+  out.push_back(0xFF & value);
+  out.push_back(0xFF & (value >> 8));
+  out.push_back(0xFF & (value >> 16));
+  out.push_back(0xFF & (value >> 24));
+}
+
+static uint32_t
+readUint32(const uint8_t* pos)
+{
+  return (static_cast<uint32_t>(pos[3]) << 24) +
+         (static_cast<uint32_t>(pos[2]) << 16) +
+         (static_cast<uint32_t>(pos[1]) << 8) +
+         pos[0];
+}
+
+// Whether a table of nCells cells folds to nFoldedCells cells: both are made up of nHash
+// equal ranges and the ranges of the larger table are a power of two times larger
+static bool
+isFoldable(size_t nCells, size_t nFoldedCells, size_t nHash)
+{
+  if (nFoldedCells == 0 || nFoldedCells % nHash != 0 || nCells % nFoldedCells != 0) {
+    return false;
+  }
+  size_t factor = nCells / nFoldedCells;
+  return (factor & (factor - 1)) == 0;
+}
+
+static void
+appendUint64(std::vector<uint8_t>& out, uint64_t value)
+{
+  appendUint32(out, static_cast<uint32_t>(value));
+  appendUint32(out, static_cast<uint32_t>(value >> 32));
+}
+
+static uint64_t
+readUint64(const uint8_t* pos)
+{
+  return (static_cast<uint64_t>(readUint32(pos + 4)) << 32) + readUint32(pos);
+}
+
+static bool
+isCompatible(const IbltParameters& parameters1, const IbltParameters& parameters2)
+{
+  return parameters1.nHash == parameters2.nHash && parameters1.checkSeed == parameters2.checkSeed &&
+         parameters1.hashFamily == parameters2.hashFamily;
+}
+
+// Contribution of a key to the digest of an IBLT (splitmix64 finalizer)
+static uint64_t
+mixKey(uint64_t key)
+{
+  key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9;
+  key = (key ^ (key >> 27)) * 0x94d049bb133111eb;
+  return key ^ (key >> 31);
+}
+
+// Zig-zag encoding maps small negative counts to small unsigned numbers
+static uint32_t
+encodeZigZag(int32_t n)
+{
+  return (static_cast<uint32_t>(n) << 1) ^ static_cast<uint32_t>(n >> 31);
+}
+
+static int32_t
+decodeZigZag(uint32_t n)
+{
+  return static_cast<int32_t>(n >> 1) ^ -static_cast<int32_t>(n & 1);
+}
+
+// Element-wise kernels over the cell arrays.  The AVX2 path is used when the library
+// is compiled with AVX2 enabled (e.g. -mavx2), SSE2 is always available on x86-64,
+// and the scalar loops handle the remainder and other architectures.
+
+// dst may be the same array as lhs, so a - b can be computed in place or into another table
+
+static void
+subtractCounts(int32_t* dst, const int32_t* lhs, const int32_t* rhs, size_t n)
+{
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 8 <= n; i += 8) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_sub_epi32(a, b));
+  }
+#elif defined(__SSE2__)
+  for (; i + 4 <= n; i += 4) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_sub_epi32(a, b));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = lhs[i] - rhs[i];
+  }
+}
+
+template<typename T>
+static void
+xorSums(T* dst, const T* lhs, const T* rhs, size_t n)
+{
+  size_t i = 0;
+#if defined(__AVX2__)
+  const size_t step = sizeof(__m256i) / sizeof(T);
+  for (; i + step <= n; i += step) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(a, b));
+  }
+#elif defined(__SSE2__)
+  const size_t step = sizeof(__m128i) / sizeof(T);
+  for (; i + step <= n; i += step) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(a, b));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = lhs[i] ^ rhs[i];
+  }
+}
+
+template<typename T>
+static bool
+isAllZero(const T* values, size_t n)
+{
+  size_t i = 0;
+#if defined(__AVX2__)
+  const size_t step = sizeof(__m256i) / sizeof(T);
+  __m256i acc = _mm256_setzero_si256();
+  for (; i + step <= n; i += step) {
+    acc = _mm256_or_si256(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)));
+  }
+  if (!_mm256_testz_si256(acc, acc)) {
+    return false;
+  }
+#elif defined(__SSE2__)
+  const size_t step = sizeof(__m128i) / sizeof(T);
+  __m128i acc = _mm_setzero_si128();
+  for (; i + step <= n; i += step) {
+    acc = _mm_or_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)));
+  }
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) {
+    return false;
+  }
+#endif
+  T rest = 0;
+  for (; i < n; i++) {
+    rest |= values[i];
+  }
+  return rest == 0;
+}
+
 bool
-HashTableEntry::isPure() const
+HashTableEntry::isPure(KeyWidth keyWidth, uint32_t checkSeed, HashFamily hashFamily) const
 {
   if (count == 1 || count == -1) {
-    uint32_t check = murmurHash3(N_HASHCHECK, keySum);
+    uint32_t check = hashKey(checkSeed, keySum, keyWidth, hashFamily);
     return keyCheck == check;
   }
 
@@ -75,134 +298,690 @@ HashTableEntry::isEmpty() const
   return count == 0 && keySum == 0 && keyCheck == 0;
 }
 
-IBLT::IBLT(size_t expectedNumEntries)
+IBLT::IBLT(size_t expectedNumEntries, CompressionScheme scheme, KeyWidth keyWidth,
+           const IbltParameters& parameters)
+  : m_compressionScheme(scheme)
+  , m_keyWidth(keyWidth)
+  , m_parameters(parameters)
 {
-  // 1.5x expectedNumEntries gives very low probability of decoding failure
-  size_t nEntries = expectedNumEntries + expectedNumEntries / 2;
-  // make nEntries exactly divisible by N_HASH
-  size_t remainder = nEntries % N_HASH;
+  // The check hash must differ from the hashes that pick the cells
+  if (parameters.nHash == 0 || parameters.nHash > MAX_N_HASH ||
+      parameters.checkSeed < parameters.nHash || !(parameters.overprovisionFactor > 0) ||
+      (parameters.hashFamily != HashFamily::MURMUR3 && parameters.hashFamily != HashFamily::WYHASH)) {
+    BOOST_THROW_EXCEPTION(Error("Invalid IBF parameters"));
+  }
+
+  // The default 1.5x expectedNumEntries gives very low probability of decoding failure
+  size_t nEntries = static_cast<size_t>(expectedNumEntries * parameters.overprovisionFactor);
+  // make nEntries exactly divisible by nHash
+  size_t remainder = nEntries % parameters.nHash;
   if (remainder != 0) {
-    nEntries += (N_HASH - remainder);
+    nEntries += (parameters.nHash - remainder);
   }
 
-  m_hashTable.resize(nEntries);
+  m_count.resize(nEntries);
+  m_keySum.resize(nEntries);
+  m_keyCheck.resize(nEntries);
+  m_nConstructedCells = nEntries;
 }
 
 void
 IBLT::initialize(const ndn::name::Component& ibltName)
 {
-  const auto& values = extractValueFromName(ibltName);
+  if (ibltName.value_size() == 0) {
+    BOOST_THROW_EXCEPTION(Error("Received IBF is empty!"));
+  }
+
+  m_isEncodedValid = false;
+  // Unknown until the table is decoded
+  m_hasDigest = false;
+
+  if (isLegacyEncoding(ibltName)) {
+    // Legacy peers only know 32-bit keys and the default hash parameters
+    if (m_keyWidth != KeyWidth::BITS_32 || !isCompatible(IbltParameters(), m_parameters)) {
+      BOOST_THROW_EXCEPTION(Error("Received IBF of a legacy peer, which has 32-bit keys and "
+                                  "the default number of hashes, check seed and hash family!"));
+    }
+    decodeLegacyTable(ibltName.value_begin(), ibltName.value_end());
+    return;
+  }
+
+  uint8_t header = *ibltName.value_begin();
+  size_t headerSize = 1;
+  if (header & HAS_DIGEST) {
+    headerSize += sizeof(uint64_t);
+  }
+  IbltParameters parameters;
+  if (header & HAS_PARAMETERS) {
+    if (ibltName.value_size() < headerSize + 1 + sizeof(uint32_t) + 1) {
+      BOOST_THROW_EXCEPTION(Error("Received IBF cannot be decoded!"));
+    }
+    parameters.nHash = ibltName.value_begin()[headerSize];
+    parameters.checkSeed = readUint32(ibltName.value_begin() + headerSize + 1);
+    parameters.hashFamily = static_cast<HashFamily>(ibltName.value_begin()[headerSize + 5]);
+    headerSize += 1 + sizeof(uint32_t) + 1;
+  }
+  if (ibltName.value_size() < headerSize) {
+    BOOST_THROW_EXCEPTION(Error("Received IBF cannot be decoded!"));
+  }
+  if (!isCompatible(parameters, m_parameters)) {
+    BOOST_THROW_EXCEPTION(Error("Received IBF has different number of hashes, check seed "
+                                "or hash family!"));
+  }
+
+  auto scheme = static_cast<CompressionScheme>(header & 0x0F);
+  const uint8_t* tableBegin = ibltName.value_begin() + headerSize;
+
+  uint8_t encoding = (header & ~(HAS_DIGEST | HAS_PARAMETERS)) >> 4;
+  if (encoding != ENCODING_SPARSE && encoding != ENCODING_SPARSE_64 &&
+      encoding != ENCODING_PACKED) {
+    BOOST_THROW_EXCEPTION(Error("Received IBF cannot be decoded!"));
+  }
+  if (encoding != ENCODING_PACKED &&
+      (encoding == ENCODING_SPARSE_64) != (m_keyWidth == KeyWidth::BITS_64)) {
+    BOOST_THROW_EXCEPTION(Error("Received IBF has different key width!"));
+  }
+
+  if (encoding == ENCODING_PACKED) {
+    decodePackedTable(scheme, tableBegin, ibltName.value_end());
+  }
+  else {
+    decodeSparseTable(scheme, tableBegin, ibltName.value_end());
+  }
+
+  auto digest = extractDigest(ibltName);
+  m_hasDigest = static_cast<bool>(digest);
+  m_digest = digest.value_or(0);
+}
+
+ndn::optional<uint64_t>
+IBLT::extractDigest(const ndn::name::Component& ibltName)
+{
+  if (ibltName.value_size() < 1 + sizeof(uint64_t) || !(*ibltName.value_begin() & HAS_DIGEST)) {
+    return ndn::nullopt;
+  }
+  return readUint64(ibltName.value_begin() + 1);
+}
 
-  if (3 * m_hashTable.size() != values.size()) {
+ndn::name::Component
+IBLT::makeDigestReference(uint64_t digest)
+{
+  std::vector<uint8_t> value;
+  value.push_back(static_cast<uint8_t>(CompressionScheme::NONE) | (ENCODING_SPARSE << 4) |
+                  HAS_DIGEST);
+  appendUint64(value, digest);
+  return ndn::name::Component(value.begin(), value.end());
+}
+
+bool
+IBLT::isDigestReference(const ndn::name::Component& ibltName)
+{
+  return ibltName.value_size() == 1 + sizeof(uint64_t) && (*ibltName.value_begin() & HAS_DIGEST);
+}
+
+void
+IBLT::resize(size_t nCells)
+{
+  if (nCells == m_count.size()) {
+    return;
+  }
+  if (nCells > m_nConstructedCells * MAX_RECEIVED_GROWTH ||
+      !isFoldable(std::max(nCells, m_count.size()), std::min(nCells, m_count.size()),
+                  m_parameters.nHash)) {
     BOOST_THROW_EXCEPTION(Error("Received IBF cannot be decoded!"));
   }
 
-  for (size_t i = 0; i < m_hashTable.size(); i++) {
-    HashTableEntry& entry = m_hashTable.at(i);
-    if (values[i * 3] != 0) {
-      entry.count = values[i * 3];
-      entry.keySum = values[(i * 3) + 1];
-      entry.keyCheck = values[(i * 3) + 2];
+  m_count.assign(nCells, 0);
+  m_keySum.assign(nCells, 0);
+  m_keyCheck.assign(nCells, 0);
+  m_isEncodedValid = false;
+}
+
+IBLT
+IBLT::fold(size_t factor) const
+{
+  size_t nFoldedCells = factor == 0 ? 0 : m_count.size() / factor;
+  if (factor == 0 || nFoldedCells * factor != m_count.size() ||
+      !isFoldable(m_count.size(), nFoldedCells, m_parameters.nHash)) {
+    BOOST_THROW_EXCEPTION(Error("IBF cannot be folded by " + std::to_string(factor)));
+  }
+
+  IBLT folded(*this);
+  folded.m_isEncodedValid = false;
+  if (factor == 1) {
+    return folded;
+  }
+
+  folded.m_count.assign(nFoldedCells, 0);
+  folded.m_keySum.assign(nFoldedCells, 0);
+  folded.m_keyCheck.assign(nFoldedCells, 0);
+
+  // Bucket b of hash function i (see getBucket) becomes bucket b % foldedBucketsPerHash
+  size_t bucketsPerHash = m_count.size() / m_parameters.nHash;
+  size_t foldedBucketsPerHash = nFoldedCells / m_parameters.nHash;
+  for (size_t i = 0; i < m_parameters.nHash; i++) {
+    for (size_t b = 0; b < bucketsPerHash; b++) {
+      size_t from = i * bucketsPerHash + b;
+      size_t to = i * foldedBucketsPerHash + b % foldedBucketsPerHash;
+      folded.m_count[to] += m_count[from];
+      folded.m_keySum[to] ^= m_keySum[from];
+      folded.m_keyCheck[to] ^= m_keyCheck[from];
     }
   }
+  return folded;
+}
+
+bool
+IBLT::isFoldableWith(size_t nCells) const
+{
+  return isFoldable(std::max(nCells, m_count.size()), std::min(nCells, m_count.size()),
+                    m_parameters.nHash);
+}
+
+size_t
+IBLT::getNumCells() const
+{
+  return m_count.size();
+}
+
+CompressionScheme
+IBLT::getCompressionScheme() const
+{
+  return m_compressionScheme;
+}
+
+KeyWidth
+IBLT::getKeyWidth() const
+{
+  return m_keyWidth;
+}
+
+const IbltParameters&
+IBLT::getParameters() const
+{
+  return m_parameters;
+}
+
+std::vector<HashTableEntry>
+IBLT::getHashTable() const
+{
+  std::vector<HashTableEntry> hashTable(m_count.size());
+  for (size_t i = 0; i < hashTable.size(); i++) {
+    hashTable[i].count = m_count[i];
+    hashTable[i].keySum = m_keySum[i];
+    hashTable[i].keyCheck = m_keyCheck[i];
+  }
+  return hashTable;
+}
+
+size_t
+IBLT::getBucket(size_t hashIndex, uint64_t key) const
+{
+  size_t bucketsPerHash = m_count.size() / m_parameters.nHash;
+  return hashIndex * bucketsPerHash +
+         (hashKey(hashIndex, key, m_keyWidth, m_parameters.hashFamily) % bucketsPerHash);
+}
+
+IBLT::KeyCells
+IBLT::locate(uint64_t key) const
+{
+  BOOST_ASSERT(m_keyWidth == KeyWidth::BITS_64 || key <= std::numeric_limits<uint32_t>::max());
+  KeyCells keyCells{key,
+                    hashKey(m_parameters.checkSeed, key, m_keyWidth, m_parameters.hashFamily), {}};
+  for (size_t i = 0; i < m_parameters.nHash; i++) {
+    keyCells.indexes[i] = getBucket(i, key);
+  }
+  return keyCells;
 }
 
 void
-IBLT::update(int plusOrMinus, uint32_t key)
+IBLT::update(int plusOrMinus, const KeyCells& keyCells)
 {
-  size_t bucketsPerHash = m_hashTable.size() / N_HASH;
+  m_isEncodedValid = false;
+  m_digest += plusOrMinus * mixKey(keyCells.key);
 
-  for (size_t i = 0; i < N_HASH; i++) {
-    size_t startEntry = i * bucketsPerHash;
-    uint32_t h = murmurHash3(i, key);
-    HashTableEntry& entry = m_hashTable.at(startEntry + (h % bucketsPerHash));
-    entry.count += plusOrMinus;
-    entry.keySum ^= key;
-    entry.keyCheck ^= murmurHash3(N_HASHCHECK, key);
+  for (size_t i = 0; i < m_parameters.nHash; i++) {
+    uint32_t index = keyCells.indexes[i];
+    m_count.at(index) += plusOrMinus;
+    m_keySum.at(index) ^= keyCells.key;
+    m_keyCheck.at(index) ^= keyCells.check;
   }
 }
 
 void
-IBLT::insert(uint32_t key)
+IBLT::updateBatch(int plusOrMinus, const std::vector<uint64_t>& keys)
+{
+  struct CellUpdate
+  {
+    size_t index;
+    uint64_t key;
+    uint32_t check;
+  };
+
+  m_isEncodedValid = false;
+
+  size_t nHash = m_parameters.nHash;
+  size_t bucketsPerHash = m_count.size() / nHash;
+  HashFamily hashFamily = m_parameters.hashFamily;
+
+  // Group the updates by hash function so that applying them walks one
+  // nHash-th of the table at a time.  (Fully sorting them by bucket costs
+  // more than the cache misses it saves.)
+  std::vector<CellUpdate> updates(keys.size() * nHash);
+  for (size_t k = 0; k < keys.size(); k++) {
+    uint64_t key = keys[k];
+    BOOST_ASSERT(m_keyWidth == KeyWidth::BITS_64 || key <= std::numeric_limits<uint32_t>::max());
+    m_digest += plusOrMinus * mixKey(key);
+    uint32_t check = hashKey(m_parameters.checkSeed, key, m_keyWidth, hashFamily);
+    for (size_t i = 0; i < nHash; i++) {
+      size_t index = i * bucketsPerHash +
+                     (hashKey(i, key, m_keyWidth, hashFamily) % bucketsPerHash);
+      updates[i * keys.size() + k] = {index, key, check};
+    }
+  }
+
+  for (const auto& update : updates) {
+    m_count[update.index] += plusOrMinus;
+    m_keySum[update.index] ^= update.key;
+    m_keyCheck[update.index] ^= update.check;
+  }
+}
+
+void
+IBLT::insert(uint64_t key)
+{
+  update(INSERT, locate(key));
+}
+
+void
+IBLT::erase(uint64_t key)
+{
+  update(ERASE, locate(key));
+}
+
+void
+IBLT::insert(const KeyCells& keyCells)
+{
+  update(INSERT, keyCells);
+}
+
+void
+IBLT::erase(const KeyCells& keyCells)
+{
+  update(ERASE, keyCells);
+}
+
+void
+IBLT::insertBatch(const std::vector<uint64_t>& keys)
 {
-  update(INSERT, key);
+  updateBatch(INSERT, keys);
 }
 
 void
-IBLT::erase(uint32_t key)
+IBLT::eraseBatch(const std::vector<uint64_t>& keys)
 {
-  update(ERASE, key);
+  updateBatch(ERASE, keys);
 }
 
 bool
-IBLT::listEntries(std::set<uint32_t>& positive, std::set<uint32_t>& negative) const
-{
-  IBLT peeled = *this;
-
-  size_t nErased = 0;
-  do {
-    nErased = 0;
-    for (const auto& entry : peeled.m_hashTable) {
-      if (entry.isPure()) {
-        if (entry.count == 1) {
-          positive.insert(entry.keySum);
-        }
-        else {
-          negative.insert(entry.keySum);
-        }
-        peeled.update(-entry.count, entry.keySum);
-        ++nErased;
-      }
+IBLT::listEntries(std::set<uint64_t>& positive, std::set<uint64_t>& negative) const
+{
+  return listEntries(positive, negative, std::numeric_limits<size_t>::max()) ==
+         DecodeResult::SUCCESS;
+}
+
+DecodeResult
+IBLT::listEntries(std::set<uint64_t>& positive, std::set<uint64_t>& negative,
+                  size_t maxEntries) const
+{
+  DecodeScratch scratch;
+  scratch.m_count = m_count;
+  scratch.m_keySum = m_keySum;
+  scratch.m_keyCheck = m_keyCheck;
+
+  std::vector<uint64_t> positiveEntries;
+  std::vector<uint64_t> negativeEntries;
+  DecodeResult result = peel(scratch, positiveEntries, negativeEntries, maxEntries);
+  positive.insert(positiveEntries.begin(), positiveEntries.end());
+  negative.insert(negativeEntries.begin(), negativeEntries.end());
+  return result;
+}
+
+DecodeResult
+IBLT::decodeDifference(const IBLT& other, DecodeScratch& scratch,
+                       std::vector<uint64_t>& positive, std::vector<uint64_t>& negative,
+                       size_t maxEntries) const
+{
+  if (m_keyWidth != other.m_keyWidth) {
+    BOOST_THROW_EXCEPTION(Error("Cannot subtract IBFs with different key widths"));
+  }
+  if (!isCompatible(m_parameters, other.m_parameters)) {
+    BOOST_THROW_EXCEPTION(Error("Cannot subtract IBFs with different hashes"));
+  }
+
+  // IBLTs of different sizes are subtracted at the smaller size
+  if (m_count.size() > other.m_count.size()) {
+    return fold(m_count.size() / other.m_count.size())
+             .decodeDifference(other, scratch, positive, negative, maxEntries);
+  }
+  if (m_count.size() < other.m_count.size()) {
+    return decodeDifference(other.fold(other.m_count.size() / m_count.size()),
+                            scratch, positive, negative, maxEntries);
+  }
+
+  // resize keeps the capacity of the previous decodes
+  size_t n = m_count.size();
+  scratch.m_count.resize(n);
+  scratch.m_keySum.resize(n);
+  scratch.m_keyCheck.resize(n);
+  subtractCounts(scratch.m_count.data(), m_count.data(), other.m_count.data(), n);
+  xorSums(scratch.m_keySum.data(), m_keySum.data(), other.m_keySum.data(), n);
+  xorSums(scratch.m_keyCheck.data(), m_keyCheck.data(), other.m_keyCheck.data(), n);
+
+  positive.clear();
+  negative.clear();
+  return peel(scratch, positive, negative, maxEntries);
+}
+
+DecodeResult
+IBLT::peel(DecodeScratch& scratch, std::vector<uint64_t>& positive,
+           std::vector<uint64_t>& negative, size_t maxEntries) const
+{
+  const std::vector<int32_t>& count = scratch.m_count;
+  const std::vector<uint64_t>& keySum = scratch.m_keySum;
+  const std::vector<uint32_t>& keyCheck = scratch.m_keyCheck;
+  size_t n = count.size();
+
+  // Peeling a key only changes the nHash cells that the key hashes to,
+  // so rather than rescanning the whole table until a pass finds nothing pure,
+  // keep a work list of cells that are (or have just become) pure.
+  std::vector<size_t>& pureCells = scratch.m_pureCells;
+  pureCells.clear();
+  for (size_t i = 0; i < n; i++) {
+    if ((count[i] == 1 || count[i] == -1) &&
+        keyCheck[i] == hashKey(m_parameters.checkSeed, keySum[i], m_keyWidth,
+                               m_parameters.hashFamily)) {
+      pureCells.push_back(i);
     }
-  } while (nErased > 0);
+  }
+
+  size_t nEntries = peelPureCells(scratch, m_parameters, m_keyWidth, positive, negative,
+                                  maxEntries);
 
   // If any buckets for one of the hash functions is not empty,
   // then we didn't peel them all:
-  for (const auto& entry : peeled.m_hashTable) {
-    if (entry.isEmpty() != true) {
-      return false;
+  if (isAllZero(reinterpret_cast<const uint32_t*>(count.data()), n) &&
+      isAllZero(keySum.data(), n) &&
+      isAllZero(keyCheck.data(), n)) {
+    return DecodeResult::SUCCESS;
+  }
+  return nEntries < maxEntries ? DecodeResult::FAILED : DecodeResult::EXCEEDED_BUDGET;
+}
+
+size_t
+IBLT::peelPureCells(DecodeScratch& scratch, const IbltParameters& parameters, KeyWidth keyWidth,
+                    std::vector<uint64_t>& positive, std::vector<uint64_t>& negative,
+                    size_t maxEntries)
+{
+  std::vector<size_t>& pureCells = scratch.m_pureCells;
+  size_t bucketsPerHash = scratch.m_count.size() / parameters.nHash;
+  size_t nEntries = 0;
+  while (!pureCells.empty() && nEntries < maxEntries) {
+    size_t pureIndex = pureCells.back();
+    pureCells.pop_back();
+
+    // Cell could have been emptied since it was queued
+    int32_t keyCount = scratch.m_count[pureIndex];
+    uint64_t key = scratch.m_keySum[pureIndex];
+    if ((keyCount != 1 && keyCount != -1) ||
+        scratch.m_keyCheck[pureIndex] != hashKey(parameters.checkSeed, key, keyWidth,
+                                                 parameters.hashFamily)) {
+      continue;
+    }
+    // A cell holding several keys passes the check above once in 2^32 times, but its
+    // key sum is also unlikely to hash to the cell: peeling it would corrupt the table
+    size_t hashIndex = pureIndex / bucketsPerHash;
+    if (hashKey(hashIndex, key, keyWidth, parameters.hashFamily) % bucketsPerHash !=
+        pureIndex % bucketsPerHash) {
+      continue;
+    }
+
+    if (keyCount == 1) {
+      positive.push_back(key);
+    }
+    else {
+      negative.push_back(key);
     }
+    ++nEntries;
+    addToScratch(scratch, parameters, keyWidth, -keyCount, key);
   }
+  return nEntries;
+}
+
+void
+IBLT::addToScratch(DecodeScratch& scratch, const IbltParameters& parameters, KeyWidth keyWidth,
+                   int32_t keyCount, uint64_t key)
+{
+  int32_t* count = scratch.m_count.data();
+  uint64_t* keySum = scratch.m_keySum.data();
+  uint32_t* keyCheck = scratch.m_keyCheck.data();
+  size_t bucketsPerHash = scratch.m_count.size() / parameters.nHash;
+
+  HashFamily hashFamily = parameters.hashFamily;
+  uint32_t check = hashKey(parameters.checkSeed, key, keyWidth, hashFamily);
+  for (size_t i = 0; i < parameters.nHash; i++) {
+    // Same as getBucket, for the size of the table in scratch
+    size_t index = i * bucketsPerHash + (hashKey(i, key, keyWidth, hashFamily) % bucketsPerHash);
+    bool wasEmpty = count[index] == 0 && keySum[index] == 0 && keyCheck[index] == 0;
+    count[index] += keyCount;
+    keySum[index] ^= key;
+    keyCheck[index] ^= check;
 
-  return true;
+    if (count[index] == 0 && keySum[index] == 0 && keyCheck[index] == 0) {
+      scratch.m_nNonEmptyCells -= !wasEmpty;
+    }
+    else {
+      scratch.m_nNonEmptyCells += wasEmpty;
+      if ((count[index] == 1 || count[index] == -1) &&
+          keyCheck[index] == hashKey(parameters.checkSeed, keySum[index], keyWidth, hashFamily)) {
+        scratch.m_pureCells.push_back(index);
+      }
+    }
+  }
 }
 
 IBLT
 IBLT::operator-(const IBLT& other) const
 {
-  BOOST_ASSERT(m_hashTable.size() == other.m_hashTable.size());
+  if (m_keyWidth != other.m_keyWidth) {
+    BOOST_THROW_EXCEPTION(Error("Cannot subtract IBFs with different key widths"));
+  }
+  if (!isCompatible(m_parameters, other.m_parameters)) {
+    BOOST_THROW_EXCEPTION(Error("Cannot subtract IBFs with different hashes"));
+  }
 
-  IBLT result(*this);
-  for (size_t i = 0; i < m_hashTable.size(); i++) {
-    HashTableEntry& e1 = result.m_hashTable.at(i);
-    const HashTableEntry& e2 = other.m_hashTable.at(i);
-    e1.count -= e2.count;
-    e1.keySum ^= e2.keySum;
-    e1.keyCheck ^= e2.keyCheck;
+  // IBLTs of different sizes are subtracted at the smaller size
+  if (m_count.size() > other.m_count.size()) {
+    return fold(m_count.size() / other.m_count.size()) - other;
+  }
+  if (m_count.size() < other.m_count.size()) {
+    return *this - other.fold(other.m_count.size() / m_count.size());
   }
 
+  IBLT result(*this);
+  result.m_isEncodedValid = false;
+  result.m_digest = m_digest - other.m_digest;
+  result.m_hasDigest = m_hasDigest && other.m_hasDigest;
+  size_t n = m_count.size();
+  subtractCounts(result.m_count.data(), m_count.data(), other.m_count.data(), n);
+  xorSums(result.m_keySum.data(), m_keySum.data(), other.m_keySum.data(), n);
+  xorSums(result.m_keyCheck.data(), m_keyCheck.data(), other.m_keyCheck.data(), n);
+
   return result;
 }
 
-bool
-operator==(const IBLT& iblt1, const IBLT& iblt2)
+IbltDifference::IbltDifference(const IBLT& local, const IBLT& remote, size_t maxEntries)
+  : m_parameters(local.getParameters())
+  , m_keyWidth(local.getKeyWidth())
+  , m_maxEntries(maxEntries)
 {
-  auto iblt1HashTable = iblt1.getHashTable();
-  auto iblt2HashTable = iblt2.getHashTable();
-  if (iblt1HashTable.size() != iblt2HashTable.size()) {
-    return false;
+  std::vector<uint64_t> positive;
+  std::vector<uint64_t> negative;
+  m_result = local.decodeDifference(remote, m_residual, positive, negative, maxEntries);
+  m_nCells = m_residual.m_count.size();
+  // A complete decode leaves no non-empty cell, otherwise they are counted when needed
+  m_residual.m_nNonEmptyCells = 0;
+  m_isResidualPrepared = m_result == DecodeResult::SUCCESS;
+  addPeeled(positive, negative);
+}
+
+IbltDifference::IbltDifference(const IBLT& local, size_t maxEntries)
+  : m_parameters(local.getParameters())
+  , m_keyWidth(local.getKeyWidth())
+  , m_maxEntries(maxEntries)
+  , m_nCells(local.getNumCells())
+  , m_isResidualPrepared(false)
+  , m_result(DecodeResult::SUCCESS)
+{
+}
+
+IbltDifference::IbltDifference(const IBLT& local, const IBLT& remote,
+                               const std::vector<uint64_t>& positive,
+                               const std::vector<uint64_t>& negative, size_t maxEntries)
+  : m_parameters(local.getParameters())
+  , m_keyWidth(local.getKeyWidth())
+  , m_maxEntries(maxEntries)
+  , m_nCells(std::min(local.getNumCells(), remote.getNumCells()))
+  , m_isResidualPrepared(false)
+  , m_result(DecodeResult::SUCCESS)
+{
+  addPeeled(positive, negative);
+}
+
+IbltDifference::IbltDifference(const IBLT& local, DecodeScratch&& residual, DecodeResult result,
+                               const std::vector<uint64_t>& positive,
+                               const std::vector<uint64_t>& negative, size_t maxEntries)
+  : m_parameters(local.getParameters())
+  , m_keyWidth(local.getKeyWidth())
+  , m_maxEntries(maxEntries)
+  , m_residual(std::move(residual))
+  , m_nCells(m_residual.m_count.size())
+  , m_isResidualPrepared(result == DecodeResult::SUCCESS)
+  , m_result(result)
+{
+  m_residual.m_nNonEmptyCells = 0;
+  addPeeled(positive, negative);
+}
+
+void
+IbltDifference::insert(uint64_t key)
+{
+  update(IBLT::INSERT, key);
+}
+
+void
+IbltDifference::erase(uint64_t key)
+{
+  update(IBLT::ERASE, key);
+}
+
+void
+IbltDifference::update(int plusOrMinus, uint64_t key)
+{
+  if (m_result == DecodeResult::EXCEEDED_BUDGET) {
+    return;
+  }
+
+  // A key that was peeled with the other sign is now on both sides
+  std::set<uint64_t>& peeled = plusOrMinus == IBLT::INSERT ? m_negative : m_positive;
+  if (peeled.erase(key) == 0) {
+    prepareResidual();
+    IBLT::addToScratch(m_residual, m_parameters, m_keyWidth, plusOrMinus, key);
+
+    size_t nPeeled = m_positive.size() + m_negative.size();
+    std::vector<uint64_t> positive;
+    std::vector<uint64_t> negative;
+    IBLT::peelPureCells(m_residual, m_parameters, m_keyWidth, positive, negative,
+                        nPeeled < m_maxEntries ? m_maxEntries - nPeeled : 0);
+    addPeeled(positive, negative);
+  }
+  updateResult();
+}
+
+void
+IbltDifference::prepareResidual()
+{
+  if (m_residual.m_count.empty()) {
+    m_residual.m_count.assign(m_nCells, 0);
+    m_residual.m_keySum.assign(m_nCells, 0);
+    m_residual.m_keyCheck.assign(m_nCells, 0);
+    m_residual.m_nNonEmptyCells = 0;
+  }
+  else if (!m_isResidualPrepared) {
+    // From now on the updates keep track of the cells they empty or fill
+    for (size_t i = 0; i < m_residual.m_count.size(); i++) {
+      if (m_residual.m_count[i] != 0 || m_residual.m_keySum[i] != 0 ||
+          m_residual.m_keyCheck[i] != 0) {
+        ++m_residual.m_nNonEmptyCells;
+      }
+    }
   }
+  m_isResidualPrepared = true;
+}
 
-  size_t N = iblt1HashTable.size();
+void
+IbltDifference::addPeeled(const std::vector<uint64_t>& positive,
+                          const std::vector<uint64_t>& negative)
+{
+  for (uint64_t key : positive) {
+    addPeeled(IBLT::INSERT, key);
+  }
+  for (uint64_t key : negative) {
+    addPeeled(IBLT::ERASE, key);
+  }
+}
 
-  for (size_t i = 0; i < N; i++) {
-    if (iblt1HashTable[i].count != iblt2HashTable[i].count ||
-        iblt1HashTable[i].keySum != iblt2HashTable[i].keySum ||
-        iblt1HashTable[i].keyCheck != iblt2HashTable[i].keyCheck)
-      return false;
+void
+IbltDifference::addPeeled(int plusOrMinus, uint64_t key)
+{
+  if (plusOrMinus == IBLT::INSERT) {
+    if (m_negative.erase(key) == 0) {
+      m_positive.insert(key);
+    }
   }
+  else {
+    if (m_positive.erase(key) == 0) {
+      m_negative.insert(key);
+    }
+  }
+}
 
-  return true;
+void
+IbltDifference::updateResult()
+{
+  // Until the first update, the cells are only allocated if some are left non-empty
+  bool isResidualEmpty = m_isResidualPrepared ? m_residual.m_nNonEmptyCells == 0 :
+                                                m_residual.m_count.empty();
+  if (isResidualEmpty) {
+    m_result = DecodeResult::SUCCESS;
+  }
+  else if (m_positive.size() + m_negative.size() >= m_maxEntries) {
+    m_result = DecodeResult::EXCEEDED_BUDGET;
+  }
+  else {
+    m_result = DecodeResult::FAILED;
+  }
+}
+
+bool
+operator==(const IBLT& iblt1, const IBLT& iblt2)
+{
+  // vector comparison of integral types reduces to a (vectorized) memcmp
+  return iblt1.m_keyWidth == iblt2.m_keyWidth &&
+         isCompatible(iblt1.m_parameters, iblt2.m_parameters) &&
+         iblt1.m_count == iblt2.m_count &&
+         iblt1.m_keySum == iblt2.m_keySum &&
+         iblt1.m_keyCheck == iblt2.m_keyCheck;
 }
 
 bool
@@ -217,7 +996,9 @@ operator<<(std::ostream& out, const IBLT& iblt)
   out << "count keySum keyCheckMatch\n";
   for (const auto& entry : iblt.getHashTable()) {
     out << entry.count << " " << entry.keySum << " ";
-    out << ((murmurHash3(N_HASHCHECK, entry.keySum) == entry.keyCheck) ||
+    out << ((hashKey(iblt.getParameters().checkSeed, entry.keySum, iblt.getKeyWidth(),
+                     iblt.getParameters().hashFamily) ==
+             entry.keyCheck) ||
            (entry.isEmpty())? "true" : "false");
     out << "\n";
   }
@@ -228,73 +1009,260 @@ operator<<(std::ostream& out, const IBLT& iblt)
 void
 IBLT::appendToName(ndn::Name& name) const
 {
-  size_t n = m_hashTable.size();
-  size_t unitSize = (32 * 3) / 8; // hard coding
-  size_t tableSize = unitSize * n;
+  name.append(getEncoded());
+}
 
-  std::vector<char> table(tableSize);
+const ndn::name::Component&
+IBLT::getEncoded() const
+{
+  if (!m_isEncodedValid) {
+    encode();
+  }
+  return m_encoded;
+}
 
-  for (size_t i = 0; i < n; i++) {
-    // table[i*12],   table[i*12+1], table[i*12+2], table[i*12+3] --> hashTable[i].count
+uint64_t
+IBLT::getDigest() const
+{
+  return m_digest;
+}
+
+uint64_t
+IBLT::getDigestAfter(const std::vector<uint64_t>& erased,
+                     const std::vector<uint64_t>& inserted) const
+{
+  uint64_t digest = m_digest;
+  for (uint64_t key : erased) {
+    digest -= mixKey(key);
+  }
+  for (uint64_t key : inserted) {
+    digest += mixKey(key);
+  }
+  return digest;
+}
+
+bool
+IBLT::hasDigest() const
+{
+  return m_hasDigest;
+}
+
+void
+IBLT::encode() const
+{
+  size_t keySize = m_keyWidth == KeyWidth::BITS_64 ? sizeof(uint64_t) : sizeof(uint32_t);
 
-    table[(i * unitSize)]   = 0xFF & m_hashTable[i].count;
-    table[(i * unitSize) + 1] = 0xFF & (m_hashTable[i].count >> 8);
-    table[(i * unitSize) + 2] = 0xFF & (m_hashTable[i].count >> 16);
-    table[(i * unitSize) + 3] = 0xFF & (m_hashTable[i].count >> 24);
+  // The sparse and packed encodings only differ in how they tell where the non-empty cells are
+  size_t nEmpty = 0;
+  size_t nNonEmpty = 0;
+  size_t sparseSize = 0;
+  size_t packedSize = 1;
+  for (size_t i = 0; i < m_count.size(); i++) {
+    if (m_count[i] == 0 && m_keySum[i] == 0 && m_keyCheck[i] == 0) {
+      ++nEmpty;
+      ++packedSize;
+      continue;
+    }
+    uint64_t count = encodeZigZag(m_count[i]);
+    sparseSize += getVarintSize(nEmpty) + getVarintSize(count);
+    packedSize += getVarintSize(count + 1);
+    ++nNonEmpty;
+    nEmpty = 0;
+  }
+  bool isPacked = packedSize < sparseSize;
 
-    // table[i*12+4], table[i*12+5], table[i*12+6], table[i*12+7] --> hashTable[i].keySum
+  std::vector<uint8_t> table;
+  table.reserve(MAX_VARINT_SIZE + std::min(sparseSize, packedSize) + nNonEmpty * (keySize + 4));
+  appendVarint(table, m_count.size());
+  if (isPacked) {
+    table.push_back(static_cast<uint8_t>(keySize));
+  }
 
-    table[(i * unitSize) + 4] = 0xFF & m_hashTable[i].keySum;
-    table[(i * unitSize) + 5] = 0xFF & (m_hashTable[i].keySum >> 8);
-    table[(i * unitSize) + 6] = 0xFF & (m_hashTable[i].keySum >> 16);
-    table[(i * unitSize) + 7] = 0xFF & (m_hashTable[i].keySum >> 24);
+  nEmpty = 0;
+  for (size_t i = 0; i < m_count.size(); i++) {
+    if (m_count[i] == 0 && m_keySum[i] == 0 && m_keyCheck[i] == 0) {
+      if (isPacked) {
+        table.push_back(0);
+      }
+      ++nEmpty;
+      continue;
+    }
+    if (isPacked) {
+      appendVarint(table, static_cast<uint64_t>(encodeZigZag(m_count[i])) + 1);
+    }
+    else {
+      appendVarint(table, nEmpty);
+      appendVarint(table, encodeZigZag(m_count[i]));
+    }
+    if (m_keyWidth == KeyWidth::BITS_64) {
+      appendUint64(table, m_keySum[i]);
+    }
+    else {
+      appendUint32(table, static_cast<uint32_t>(m_keySum[i]));
+    }
+    appendUint32(table, m_keyCheck[i]);
+    nEmpty = 0;
+  }
 
-    // table[i*12+8], table[i*12+9], table[i*12+10], table[i*12+11] --> hashTable[i].keyCheck
+  CompressionScheme scheme = table.size() < MIN_COMPRESS_SIZE ? CompressionScheme::NONE
+                                                              : m_compressionScheme;
+  auto compressed = compress(scheme, table.data(), table.size());
 
-    table[(i * unitSize) + 8] = 0xFF & m_hashTable[i].keyCheck;
-    table[(i * unitSize) + 9] = 0xFF & (m_hashTable[i].keyCheck >> 8);
-    table[(i * unitSize) + 10] = 0xFF & (m_hashTable[i].keyCheck >> 16);
-    table[(i * unitSize) + 11] = 0xFF & (m_hashTable[i].keyCheck >> 24);
+  std::vector<uint8_t> value;
+  value.reserve(1 + sizeof(uint64_t) + compressed->size());
+  uint8_t encoding = isPacked ? ENCODING_PACKED :
+                     m_keyWidth == KeyWidth::BITS_64 ? ENCODING_SPARSE_64 : ENCODING_SPARSE;
+  bool hasParameters = !isCompatible(m_parameters, IbltParameters());
+  value.push_back(static_cast<uint8_t>(scheme) | (encoding << 4) |
+                  (m_hasDigest ? HAS_DIGEST : 0) | (hasParameters ? HAS_PARAMETERS : 0));
+  if (m_hasDigest) {
+    appendUint64(value, m_digest);
+  }
+  if (hasParameters) {
+    value.push_back(m_parameters.nHash);
+    appendUint32(value, m_parameters.checkSeed);
+    value.push_back(static_cast<uint8_t>(m_parameters.hashFamily));
   }
+  value.insert(value.end(), compressed->begin(), compressed->end());
 
-  bio::filtering_streambuf<bio::input> in;
-  in.push(bio::zlib_compressor());
-  in.push(bio::array_source(table.data(), table.size()));
+  m_encoded = ndn::name::Component(value.begin(), value.end());
+  m_isEncodedValid = true;
+}
+
+void
+IBLT::decodeLegacyTable(const uint8_t* begin, const uint8_t* end)
+{
+  const size_t unitSize = (32 * 3) / 8; // hard coding
 
-  std::stringstream sstream;
-  bio::copy(in, sstream);
+  // The size of the table is only known once it is decompressed,
+  // so decompress it once to check the size before touching the table
+  size_t tableSize = DecompressingReader(CompressionScheme::ZLIB, begin, end - begin).skipAll();
+  if (tableSize % unitSize != 0) {
+    BOOST_THROW_EXCEPTION(Error("Received IBF cannot be decoded!"));
+  }
+  resize(tableSize / unitSize);
 
-  std::string compressedIBF = sstream.str();
-  name.append(compressedIBF.begin(), compressedIBF.end());
+  DecompressingReader reader(CompressionScheme::ZLIB, begin, end - begin);
+  for (size_t i = 0; i < m_count.size(); i++) {
+    if (!reader.fill(unitSize)) {
+      // The compressed table changed between the two passes
+      clear();
+      BOOST_THROW_EXCEPTION(Error("Received IBF cannot be decoded!"));
+    }
+    const uint8_t* cell = reader.pos();
+    m_count[i] = readUint32(cell);
+    m_keySum[i] = readUint32(cell + 4);
+    m_keyCheck[i] = readUint32(cell + 8);
+    reader.advance(cell + unitSize);
+  }
 }
 
-std::vector<uint32_t>
-IBLT::extractValueFromName(const ndn::name::Component& ibltName) const
+void
+IBLT::decodeSparseTable(CompressionScheme scheme, const uint8_t* begin, const uint8_t* end)
 {
-  std::string compressed(ibltName.value_begin(), ibltName.value_end());
+  DecompressingReader reader(scheme, begin, end - begin);
 
-  bio::filtering_streambuf<bio::input> in;
-  in.push(bio::zlib_decompressor());
-  in.push(bio::array_source(compressed.data(), compressed.size()));
+  reader.fill(MAX_VARINT_SIZE);
+  const uint8_t* pos = reader.pos();
+  uint64_t nCells = 0;
+  if (!readVarint(pos, reader.end(), nCells) || nCells > std::numeric_limits<uint32_t>::max()) {
+    BOOST_THROW_EXCEPTION(Error("Received IBF cannot be decoded!"));
+  }
+  reader.advance(pos);
+  resize(nCells);
+  clear();
 
-  std::stringstream sstream;
-  bio::copy(in, sstream);
-  std::string ibltStr = sstream.str();
+  size_t keySize = m_keyWidth == KeyWidth::BITS_64 ? sizeof(uint64_t) : sizeof(uint32_t);
+  size_t i = 0;
+  try {
+    while (reader.fill(1)) {
+      // Skipped cells, count, keySum and keyCheck
+      reader.fill(2 * MAX_VARINT_SIZE + keySize + 4);
+      pos = reader.pos();
+      const uint8_t* cellEnd = reader.end();
+      uint64_t nEmpty = 0;
+      uint64_t count = 0;
+      if (!readVarint(pos, cellEnd, nEmpty) || nEmpty >= nCells - i ||
+          !readVarint(pos, cellEnd, count) || count > std::numeric_limits<uint32_t>::max() ||
+          static_cast<size_t>(cellEnd - pos) < keySize + 4) {
+        BOOST_THROW_EXCEPTION(Error("Received IBF cannot be decoded!"));
+      }
 
-  std::vector<uint8_t> ibltValues(ibltStr.begin(), ibltStr.end());
-  size_t n = ibltValues.size() / 4;
+      i += nEmpty;
+      m_count[i] = decodeZigZag(static_cast<uint32_t>(count));
+      m_keySum[i] = keySize == sizeof(uint64_t) ? readUint64(pos) : readUint32(pos);
+      m_keyCheck[i] = readUint32(pos + keySize);
+      reader.advance(pos + keySize + 4);
+      ++i;
+    }
+  }
+  catch (const std::exception&) {
+    // Leave the table empty rather than half-decoded
+    clear();
+    throw;
+  }
+}
 
-  std::vector<uint32_t> values(n, 0);
+void
+IBLT::decodePackedTable(CompressionScheme scheme, const uint8_t* begin, const uint8_t* end)
+{
+  DecompressingReader reader(scheme, begin, end - begin);
 
-  for (size_t i = 0; i < 4 * n; i += 4) {
-    uint32_t t = (ibltValues[i + 3] << 24) +
-                 (ibltValues[i + 2] << 16) +
-                 (ibltValues[i + 1] << 8)  +
-                 ibltValues[i];
-    values[i / 4] = t;
+  size_t keySize = m_keyWidth == KeyWidth::BITS_64 ? sizeof(uint64_t) : sizeof(uint32_t);
+  reader.fill(MAX_VARINT_SIZE + 1);
+  const uint8_t* pos = reader.pos();
+  uint64_t nCells = 0;
+  if (!readVarint(pos, reader.end(), nCells) || nCells > std::numeric_limits<uint32_t>::max() ||
+      pos == reader.end()) {
+    BOOST_THROW_EXCEPTION(Error("Received IBF cannot be decoded!"));
+  }
+  if (*pos != keySize) {
+    BOOST_THROW_EXCEPTION(Error("Received IBF has different key width!"));
   }
+  reader.advance(pos + 1);
+  resize(nCells);
+  clear();
 
-  return values;
+  try {
+    for (size_t i = 0; i < nCells; i++) {
+      // Count, keySum and keyCheck
+      reader.fill(MAX_VARINT_SIZE + keySize + 4);
+      pos = reader.pos();
+      uint64_t count = 0;
+      if (!readVarint(pos, reader.end(), count) ||
+          count > static_cast<uint64_t>(std::numeric_limits<uint32_t>::max()) + 1) {
+        BOOST_THROW_EXCEPTION(Error("Received IBF cannot be decoded!"));
+      }
+      if (count == 0) {
+        reader.advance(pos);
+        continue;
+      }
+      if (static_cast<size_t>(reader.end() - pos) < keySize + 4) {
+        BOOST_THROW_EXCEPTION(Error("Received IBF cannot be decoded!"));
+      }
+
+      m_count[i] = decodeZigZag(static_cast<uint32_t>(count - 1));
+      m_keySum[i] = keySize == sizeof(uint64_t) ? readUint64(pos) : readUint32(pos);
+      m_keyCheck[i] = readUint32(pos + keySize);
+      reader.advance(pos + keySize + 4);
+    }
+    if (reader.fill(1)) {
+      BOOST_THROW_EXCEPTION(Error("Received IBF cannot be decoded!"));
+    }
+  }
+  catch (const std::exception&) {
+    // Leave the table empty rather than half-decoded
+    clear();
+    throw;
+  }
+}
+
+void
+IBLT::clear()
+{
+  std::fill(m_count.begin(), m_count.end(), 0);
+  std::fill(m_keySum.begin(), m_keySum.end(), 0);
+  std::fill(m_keyCheck.begin(), m_keyCheck.end(), 0);
 }
 
 } // namespace psync
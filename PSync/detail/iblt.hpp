@@ -46,31 +46,63 @@
 #ifndef PSYNC_IBLT_HPP
 #define PSYNC_IBLT_HPP
 
+#include "PSync/common.hpp"
+
 #include <ndn-cxx/name.hpp>
+#include <ndn-cxx/util/backports.hpp>
 
+#include <array>
 #include <inttypes.h>
+#include <limits>
 #include <set>
 #include <vector>
 #include <string>
 
 namespace psync {
 
+extern const size_t N_HASH;
+extern const size_t N_HASHCHECK;
+
 class HashTableEntry
 {
 public:
   int32_t count;
-  uint32_t keySum;
+  uint64_t keySum;
   uint32_t keyCheck;
 
   bool
-  isPure() const;
+  isPure(KeyWidth keyWidth = KeyWidth::DEFAULT, uint32_t checkSeed = N_HASHCHECK,
+         HashFamily hashFamily = HashFamily::DEFAULT) const;
 
   bool
   isEmpty() const;
 };
 
-extern const size_t N_HASH;
-extern const size_t N_HASHCHECK;
+enum class DecodeResult {
+  SUCCESS,
+  FAILED,
+  EXCEEDED_BUDGET
+};
+
+/**
+ * @brief Working memory for IBLT::decodeDifference
+ *
+ * Keeping one around (e.g. one per producer) lets repeated decodes reuse the
+ * memory of the table being peeled instead of allocating it every time.
+ */
+class DecodeScratch
+{
+private:
+  std::vector<int32_t> m_count;
+  std::vector<uint64_t> m_keySum;
+  std::vector<uint32_t> m_keyCheck;
+  std::vector<size_t> m_pureCells;
+  // Only kept up to date by IbltDifference
+  size_t m_nNonEmptyCells = 0;
+
+  friend class IBLT;
+  friend class IbltDifference;
+};
 
 /**
  * @brief Invertible Bloom Lookup Table (Invertible Bloom Filter)
@@ -86,27 +118,105 @@ public:
     using std::runtime_error::runtime_error;
   };
 
+  /// Largest supported number of hash functions (IbltParameters::nHash)
+  static const size_t MAX_N_HASH = 8;
+
+  /**
+   * @brief A key with the cells it hashes to and its check hash, see locate
+   *
+   * Lets a key that is inserted now and erased later be hashed only once.
+   * The cells are kept inline, so a KeyCells can be copied and stored without allocating.
+   */
+  struct KeyCells
+  {
+    uint64_t key;
+    uint32_t check;
+    /// the first nHash entries are the cells, one per hash function
+    std::array<uint32_t, MAX_N_HASH> indexes;
+  };
+
   /**
    * @brief constructor
    *
    * @param expectedNumEntries the expected number of entries in the IBLT
+   * @param scheme compression to use when appending the IBLT to a name
+   * @param keyWidth width of the keys; with BITS_32 only keys below 2^32 can be inserted
+   * @param parameters number of hash functions, cells per expected entry, check seed
+   *        and hash family
+   * @throws Error if the parameters are invalid
    */
-  explicit IBLT(size_t expectedNumEntries);
+  explicit
+  IBLT(size_t expectedNumEntries, CompressionScheme scheme = CompressionScheme::DEFAULT,
+       KeyWidth keyWidth = KeyWidth::DEFAULT, const IbltParameters& parameters = IbltParameters());
 
   /**
    * @brief Populate the hash table using the vector representation of IBLT
    *
+   * The component may be compressed with any scheme, not just the one of this IBLT.
+   * It may also be the headerless zlib-compressed fixed table of legacy PSync versions,
+   * which this IBLT must have 32-bit keys and the default IbltParameters to decode.
+   * It may also hold a larger or smaller table, as long as one folds to the other
+   * (see fold), in which case this IBLT takes the size of the received one.  A larger
+   * table may be at most MAX_RECEIVED_GROWTH times the size this IBLT was constructed
+   * with, so that a short sparse encoding cannot make us allocate a huge table.
+   *
    * @param ibltName the Component representation of IBLT
-   * @throws Error if size of values is not compatible with this IBF
+   * @throws Error if size of values is not compatible with this IBF,
+   *         or the received IBF has a different key width
+   * @throws CompressionError if the component cannot be decompressed
    */
   void
   initialize(const ndn::name::Component& ibltName);
 
+  /// How many times larger than the constructed size a received table can be
+  static const size_t MAX_RECEIVED_GROWTH = 16;
+
   void
-  insert(uint32_t key);
+  insert(uint64_t key);
 
   void
-  erase(uint32_t key);
+  erase(uint64_t key);
+
+  /**
+   * @brief Hash key to its cells and check hash
+   *
+   * The result is only valid for IBLTs with the same number of cells and parameters.
+   */
+  KeyCells
+  locate(uint64_t key) const;
+
+  /**
+   * @brief Insert a key located by locate, without hashing it again
+   */
+  void
+  insert(const KeyCells& keyCells);
+
+  /**
+   * @brief Erase a key located by locate, without hashing it again
+   */
+  void
+  erase(const KeyCells& keyCells);
+
+  /**
+   * @brief Insert several keys at once
+   *
+   * Equivalent to calling insert for every key, but all bucket indexes and
+   * check hashes are computed first and the cells are then updated in
+   * bucket order, which is considerably faster for large batches.
+   *
+   * @param keys the keys to be inserted
+   */
+  void
+  insertBatch(const std::vector<uint64_t>& keys);
+
+  /**
+   * @brief Erase several keys at once
+   *
+   * @param keys the keys to be erased
+   * @sa insertBatch
+   */
+  void
+  eraseBatch(const std::vector<uint64_t>& keys);
 
   /**
    * @brief List all the entries in the IBLT
@@ -120,25 +230,118 @@ public:
    * @return true if decoding is complete successfully
    */
   bool
-  listEntries(std::set<uint32_t>& positive, std::set<uint32_t>& negative) const;
+  listEntries(std::set<uint64_t>& positive, std::set<uint64_t>& negative) const;
+
+  /**
+   * @brief List the entries in the IBLT, giving up once maxEntries of them are listed
+   *
+   * Peeling stops as soon as positive and negative together hold maxEntries entries
+   * (so the work is bounded by maxEntries too), unless these were all the entries.
+   * Callers that treat that many differences as too many to handle need not wait
+   * for the rest of a decode that is likely to fail anyway.
+   *
+   * @param positive
+   * @param negative
+   * @param maxEntries the budget of entries to list
+   * @return SUCCESS if decoding is complete, FAILED if it cannot be completed and
+   *         EXCEEDED_BUDGET if maxEntries entries were listed and more remain
+   */
+  DecodeResult
+  listEntries(std::set<uint64_t>& positive, std::set<uint64_t>& negative,
+              size_t maxEntries) const;
 
+  /**
+   * @brief List the entries of the difference of this IBLT and other
+   *
+   * Same as (*this - other).listEntries(positive, negative, maxEntries), except that
+   * the difference is computed straight into scratch and peeled there, so decoding
+   * does not copy the tables, and that the entries are written to flat vectors.
+   *
+   * @param other the IBLT to subtract, e.g. the one received in a sync interest
+   * @param scratch working memory, reused across calls
+   * @param positive cleared, then receives the entries in this IBLT but not in other
+   * @param negative cleared, then receives the entries in other but not in this IBLT
+   * @param maxEntries the budget of entries to list
+   * @throws Error if the IBLTs have different key widths or sizes that do not fold
+   */
+  DecodeResult
+  decodeDifference(const IBLT& other, DecodeScratch& scratch,
+                   std::vector<uint64_t>& positive, std::vector<uint64_t>& negative,
+                   size_t maxEntries = std::numeric_limits<size_t>::max()) const;
+
+  /**
+   * @brief Subtract other from this IBLT
+   *
+   * If the sizes differ, the larger IBLT is folded to the size of the smaller one first.
+   *
+   * @throws Error if neither IBLT folds to the size of the other,
+   *         or the IBLTs have different key widths
+   */
   IBLT
   operator-(const IBLT& other) const;
 
+  /**
+   * @brief Get a copy of this IBLT folded to 1/factor of its size
+   *
+   * Each hash function maps keys to its own range of cells (see getBucket).
+   * Folding combines, within each range, the cells whose indexes are equal modulo
+   * the folded range size, which is the cell the key would have been mapped to
+   * in an IBLT of the folded size.  So a folded IBLT can be subtracted from and
+   * decoded together with an IBLT that was created with the smaller size,
+   * though it decodes fewer differences than the unfolded one.
+   *
+   * @param factor a power of two that divides the number of cells per hash function
+   * @throws Error if the IBLT cannot be folded by factor
+   */
+  IBLT
+  fold(size_t factor) const;
+
+  /**
+   * @brief Whether this IBLT and an IBLT of nCells cells fold to one another (see fold)
+   */
+  bool
+  isFoldableWith(size_t nCells) const;
+
+  size_t
+  getNumCells() const;
+
+  CompressionScheme
+  getCompressionScheme() const;
+
+  KeyWidth
+  getKeyWidth() const;
+
+  const IbltParameters&
+  getParameters() const;
+
+  /**
+   * @brief Get a copy of the hash table as a vector of cells
+   */
   std::vector<HashTableEntry>
-  getHashTable() const
-  {
-    return m_hashTable;
-  }
+  getHashTable() const;
 
   /**
    * @brief Appends self to name
    *
-   * Encodes our hash table from uint32_t vector to uint8_t vector
-   * We create a uin8_t vector 12 times the size of uint32_t vector
-   * We put the first count in first 4 cells, keySum in next 4, and keyCheck in next 4.
-   * Repeat for all the other cells of the hash table.
-   * Then we append this uint8_t vector to the name.
+   * The name component starts with a header byte that holds the CompressionScheme
+   * in its low four bits, the table encoding in the next two bits, then whether the
+   * number of hash functions (1 byte), the check seed (4 bytes) and the HashFamily
+   * (1 byte) are included and,
+   * in the top bit, whether the 8-byte digest of the IBLT (see getDigest) is included.
+   * The digest follows the header, then the hash parameters, which are only sent
+   * when they differ from the defaults.  The (compressed) encoded table comes last.
+   *
+   * We use the sparse or the packed table encoding, whichever is smaller.  The sparse
+   * encoding is the number of cells, then for every non-empty cell the number of empty
+   * cells skipped before it, its count (zig-zag encoded), its keySum and its keyCheck.
+   * The packed encoding is the number of cells and the key width in bytes, then for
+   * every cell 0 if it is empty, or else its count (zig-zag encoded) plus one, its keySum
+   * and its keyCheck; it is smaller when most cells are non-empty.  Numbers are varints,
+   * the sums are little endian and 4 bytes long, except for keySum which is 8 bytes long
+   * with 64-bit keys.  Small tables are sent uncompressed since they consist mostly of
+   * the hash sums, which do not compress.
+   *
+   * The encoding is cached until the IBLT is next modified.
    *
    * @param name
    */
@@ -146,25 +349,300 @@ public:
   appendToName(ndn::Name& name) const;
 
   /**
-   * @brief Extracts IBLT from name component
+   * @brief Get the name component that appendToName appends
+   */
+  const ndn::name::Component&
+  getEncoded() const;
+
+  /**
+   * @brief Get a digest of the keys in the IBLT
+   *
+   * The digest is the sum of a hash of every key, kept up to date by insert and
+   * erase, so it costs nothing to get.  IBLTs with the same keys have the same
+   * digest, and IBLTs with different keys almost certainly different digests
+   * (the digest of a difference is the difference of the digests).
+   * The digest is carried in the encoding, see appendToName and extractDigest.
+   */
+  uint64_t
+  getDigest() const;
+
+  /**
+   * @brief Get the digest this IBLT would have with the keys in erased erased
+   *        and the keys in inserted inserted
+   *
+   * Tells whether a decoded difference to another IBLT accounts for its digest:
+   * with positive erased and negative inserted, the result is the other's digest.
+   */
+  uint64_t
+  getDigestAfter(const std::vector<uint64_t>& erased,
+                 const std::vector<uint64_t>& inserted) const;
+
+  /**
+   * @brief Whether the digest is known, which it is unless the IBLT was
+   *        initialized from an encoding without digest
+   */
+  bool
+  hasDigest() const;
+
+  /**
+   * @brief Get the digest carried in the encoding of an IBLT, without decoding it
    *
-   * Converts the name into a uint8_t vector which is then decoded to a
-   * a uint32_t vector.
+   * Lets the receiver of an IBLT tell that it equals its own before
+   * decompressing and decoding it.
    *
-   * @param ibltName IBLT represented as a Name Component
-   * @return a uint32_t vector representing the hash table of the IBLT
+   * @return the digest, or nullopt if the encoding does not carry one
    */
-  std::vector<uint32_t>
-  extractValueFromName(const ndn::name::Component& ibltName) const;
+  static ndn::optional<uint64_t>
+  extractDigest(const ndn::name::Component& ibltName);
+
+  /**
+   * @brief Make a name component that stands for an IBLT with the given digest
+   *
+   * It is encoded as an IBLT with a digest but no table, so extractDigest works on it
+   * and initialize throws.  Only the holder of that IBLT (or of its recent history)
+   * can tell what the difference to it is.
+   */
+  static ndn::name::Component
+  makeDigestReference(uint64_t digest);
+
+  /**
+   * @brief Whether ibltName was made by makeDigestReference
+   */
+  static bool
+  isDigestReference(const ndn::name::Component& ibltName);
 
 private:
+  /**
+   * @brief Get the index of the cell that the given hash function maps key to
+   *
+   * The table is split into nHash equal ranges, one per hash function.
+   */
+  size_t
+  getBucket(size_t hashIndex, uint64_t key) const;
+
+  void
+  update(int plusOrMinus, const KeyCells& keyCells);
+
+  /**
+   * @brief Peel the table in scratch, whose cells are hashed as the ones of this IBLT
+   */
+  DecodeResult
+  peel(DecodeScratch& scratch, std::vector<uint64_t>& positive,
+       std::vector<uint64_t>& negative, size_t maxEntries) const;
+
+  /**
+   * @brief Peel the cells in the work list of scratch until it is empty or maxEntries
+   *        keys are peeled
+   *
+   * @return number of keys peeled
+   */
+  static size_t
+  peelPureCells(DecodeScratch& scratch, const IbltParameters& parameters, KeyWidth keyWidth,
+                std::vector<uint64_t>& positive, std::vector<uint64_t>& negative,
+                size_t maxEntries);
+
+  /**
+   * @brief Add keyCount times key to the cells of scratch that key hashes to,
+   *        queueing the ones that become pure in its work list
+   */
+  static void
+  addToScratch(DecodeScratch& scratch, const IbltParameters& parameters, KeyWidth keyWidth,
+               int32_t keyCount, uint64_t key);
+
+  void
+  updateBatch(int plusOrMinus, const std::vector<uint64_t>& keys);
+
+  void
+  encode() const;
+
+  /**
+   * @brief Resize the (cleared) table to receive a table of nCells cells
+   *
+   * @throws Error if nCells and the current size do not fold to each other,
+   *         or nCells is more than MAX_RECEIVED_GROWTH times the constructed size
+   */
+  void
+  resize(size_t nCells);
+
+  /**
+   * @brief Decode the zlib-compressed table of legacy peers, with 12 bytes
+   *        (count, keySum, keyCheck) per cell
+   *
+   * The table is decompressed as it is decoded (see DecompressingReader).
+   */
   void
-  update(int plusOrMinus, uint32_t key);
+  decodeLegacyTable(const uint8_t* begin, const uint8_t* end);
+
+  /**
+   * @brief Decode table in the sparse encoding described in appendToName
+   *
+   * The table is decompressed as it is decoded (see DecompressingReader).
+   */
+  void
+  decodeSparseTable(CompressionScheme scheme, const uint8_t* begin, const uint8_t* end);
+
+  /**
+   * @brief Decode table in the packed encoding described in appendToName
+   *
+   * The table is decompressed as it is decoded (see DecompressingReader).
+   */
+  void
+  decodePackedTable(CompressionScheme scheme, const uint8_t* begin, const uint8_t* end);
+
+  void
+  clear();
 
 private:
-  std::vector<HashTableEntry> m_hashTable;
+  // Cells are stored as a structure of arrays so that subtraction, comparison,
+  // and the emptiness check can run over each field with vector instructions
+  std::vector<int32_t> m_count;
+  std::vector<uint64_t> m_keySum;
+  std::vector<uint32_t> m_keyCheck;
+  CompressionScheme m_compressionScheme;
+  KeyWidth m_keyWidth;
+  IbltParameters m_parameters;
+  // Number of cells this IBLT was constructed with, which bounds the received tables
+  size_t m_nConstructedCells;
+  uint64_t m_digest = 0;
+  bool m_hasDigest = true;
+  // Encoded IBLT, valid until the next modification
+  mutable ndn::name::Component m_encoded;
+  mutable bool m_isEncodedValid = false;
   static const int INSERT = 1;
   static const int ERASE = -1;
+
+  friend bool
+  operator==(const IBLT& iblt1, const IBLT& iblt2);
+
+  friend class IbltDifference;
+};
+
+/**
+ * @brief Difference between our IBLT and a received one, decoded once and then kept
+ *        up to date as our IBLT changes
+ *
+ * Applying an update to our IBLT costs about as much as the update itself, plus peeling
+ * the keys that the update makes peelable, rather than a new subtraction and decode.
+ */
+class IbltDifference
+{
+public:
+  /**
+   * @brief Decode the difference between local and remote, see IBLT::decodeDifference
+   *
+   * @param maxEntries number of differences after which to stop decoding
+   * @throws IBLT::Error if the IBLTs cannot be subtracted
+   */
+  IbltDifference(const IBLT& local, const IBLT& remote,
+                 size_t maxEntries = std::numeric_limits<size_t>::max());
+
+  /**
+   * @brief No difference, as between local and an IBLT with the same digest
+   *
+   * Nothing is subtracted or peeled, the cells are only allocated by the first update.
+   */
+  explicit
+  IbltDifference(const IBLT& local, size_t maxEntries = std::numeric_limits<size_t>::max());
+
+  /**
+   * @brief Difference that IBLT::decodeDifference between local and remote fully decoded
+   *
+   * Takes the result of that decode instead of decoding again: remote is only used for
+   * its size, and the cells, which are all empty, are only allocated by the first update.
+   */
+  IbltDifference(const IBLT& local, const IBLT& remote, const std::vector<uint64_t>& positive,
+                 const std::vector<uint64_t>& negative,
+                 size_t maxEntries = std::numeric_limits<size_t>::max());
+
+  /**
+   * @brief Difference that IBLT::decodeDifference did not fully decode
+   *
+   * Takes over what is left in the scratch of that decode instead of decoding again.
+   *
+   * @param residual scratch of the decode, moved into this difference
+   * @param result, positive, negative result of the decode
+   */
+  IbltDifference(const IBLT& local, DecodeScratch&& residual, DecodeResult result,
+                 const std::vector<uint64_t>& positive, const std::vector<uint64_t>& negative,
+                 size_t maxEntries = std::numeric_limits<size_t>::max());
+
+  /**
+   * @brief Apply the insertion of key into the local IBLT
+   */
+  void
+  insert(uint64_t key);
+
+  /**
+   * @brief Apply the erasure of key from the local IBLT
+   */
+  void
+  erase(uint64_t key);
+
+  /**
+   * @brief Get the result of decoding the difference
+   *
+   * Once the budget is exceeded, the difference is no longer updated.
+   */
+  DecodeResult
+  getResult() const
+  {
+    return m_result;
+  }
+
+  /**
+   * @brief Get the decoded keys that are only in the local IBLT
+   */
+  const std::set<uint64_t>&
+  getPositive() const
+  {
+    return m_positive;
+  }
+
+  /**
+   * @brief Get the decoded keys that are only in the remote IBLT
+   */
+  const std::set<uint64_t>&
+  getNegative() const
+  {
+    return m_negative;
+  }
+
+private:
+  void
+  update(int plusOrMinus, uint64_t key);
+
+  /**
+   * @brief Allocate the cells left empty by the constructors, or count the non-empty
+   *        ones left by a decode, before the first update
+   */
+  void
+  prepareResidual();
+
+  void
+  addPeeled(const std::vector<uint64_t>& positive, const std::vector<uint64_t>& negative);
+
+  /**
+   * @brief Add a peeled key, which cancels out the same key peeled with the other sign
+   */
+  void
+  addPeeled(int plusOrMinus, uint64_t key);
+
+  void
+  updateResult();
+
+private:
+  IbltParameters m_parameters;
+  KeyWidth m_keyWidth;
+  size_t m_maxEntries;
+  // What is left of the difference once the decoded keys are peeled, at the size of
+  // the smaller IBLT; empty until the first update if nothing is left
+  DecodeScratch m_residual;
+  size_t m_nCells;
+  // Whether m_residual.m_nNonEmptyCells is up to date
+  bool m_isResidualPrepared;
+  std::set<uint64_t> m_positive;
+  std::set<uint64_t> m_negative;
+  DecodeResult m_result;
 };
 
 bool
@@ -0,0 +1,375 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014-2019,  The University of Memphis
+ *
+ * This file is part of PSync.
+ * See AUTHORS.md for complete list of PSync authors and contributors.
+ *
+ * PSync is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU Lesser General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * PSync is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along with
+ * PSync, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "PSync/detail/rateless-iblt.hpp"
+#include "PSync/detail/state.hpp"
+#include "PSync/detail/util.hpp"
+
+#include <cmath>
+#include <limits>
+
+namespace psync {
+
+// Seed of the hash that starts the sequence of coded symbols of a key
+const uint32_t SYMBOL_MAPPING_SEED = 7;
+
+// Hash of the little endian bytes of key, which starts the sequence of coded symbols of key
+static uint64_t
+hashKeyBytes(uint64_t key, KeyWidth keyWidth)
+{
+  uint8_t bytes[sizeof(uint64_t)];
+  size_t nBytes = static_cast<size_t>(keyWidth) / 8;
+  for (size_t i = 0; i < nBytes; ++i) {
+    bytes[i] = 0xFF & (key >> (8 * i));
+  }
+  return murmurHash3x64(SYMBOL_MAPPING_SEED, bytes, nBytes);
+}
+
+static size_t
+getSymbolSize(KeyWidth keyWidth)
+{
+  return sizeof(int32_t) + static_cast<size_t>(keyWidth) / 8 + sizeof(uint32_t);
+}
+
+static void
+appendUint(std::vector<uint8_t>& out, uint64_t value, size_t nBytes)
+{
+  for (size_t i = 0; i < nBytes; ++i) {
+    out.push_back(0xFF & (value >> (8 * i)));
+  }
+}
+
+static uint64_t
+readUint(const uint8_t* pos, size_t nBytes)
+{
+  uint64_t value = 0;
+  for (size_t i = nBytes; i-- > 0;) {
+    value = (value << 8) + pos[i];
+  }
+  return value;
+}
+
+// TLV type and length numbers (NDN packet format)
+static void
+appendVarNumber(std::vector<uint8_t>& out, uint64_t value)
+{
+  if (value < 253) {
+    out.push_back(static_cast<uint8_t>(value));
+    return;
+  }
+  size_t nBytes = value <= 0xFFFF ? 2 : (value <= 0xFFFFFFFF ? 4 : 8);
+  out.push_back(nBytes == 2 ? 253 : (nBytes == 4 ? 254 : 255));
+  for (size_t i = nBytes; i-- > 0;) {
+    out.push_back(0xFF & (value >> (8 * i)));
+  }
+}
+
+static bool
+readVarNumber(const uint8_t*& pos, const uint8_t* end, uint64_t& value)
+{
+  if (pos == end) {
+    return false;
+  }
+  size_t nBytes = *pos < 253 ? 0 : (*pos == 253 ? 2 : (*pos == 254 ? 4 : 8));
+  if (static_cast<size_t>(end - pos) < 1 + nBytes) {
+    return false;
+  }
+  value = nBytes == 0 ? *pos : 0;
+  for (size_t i = 1; i <= nBytes; ++i) {
+    value = (value << 8) + pos[i];
+  }
+  pos += 1 + nBytes;
+  return true;
+}
+
+SymbolMapping::SymbolMapping(uint64_t key, KeyWidth keyWidth)
+  : m_prng(hashKeyBytes(key, keyWidth))
+  , m_index(0)
+{
+}
+
+void
+SymbolMapping::next()
+{
+  // The gap to the next index is drawn so that the key is mapped to index i
+  // with probability 1/(1 + i/2), from a uniform 64-bit random number r
+  m_prng *= 0xda942042e4dd58b5;
+  double gap = std::ceil((m_index + 1.5) *
+                         ((4294967296.0 / std::sqrt(static_cast<double>(m_prng) + 1)) - 1));
+  if (gap >= static_cast<double>(std::numeric_limits<uint64_t>::max() - m_index)) {
+    m_index = std::numeric_limits<uint64_t>::max();
+  }
+  else {
+    m_index += std::max<uint64_t>(static_cast<uint64_t>(gap), 1);
+  }
+}
+
+RatelessEncoder::RatelessEncoder(KeyWidth keyWidth, size_t nCachedSymbols)
+  : m_keyWidth(keyWidth)
+  , m_state(std::make_shared<State>())
+{
+  m_state->cachedSymbols.assign(nCachedSymbols, HashTableEntry{0, 0, 0});
+}
+
+void
+RatelessEncoder::insert(uint64_t key)
+{
+  if (m_state->keys.count(key) == 0) {
+    State& state = getOwnState();
+    state.keys.insert(key);
+    updateCachedSymbols(state, key, 1);
+  }
+}
+
+void
+RatelessEncoder::erase(uint64_t key)
+{
+  if (m_state->keys.count(key) > 0) {
+    State& state = getOwnState();
+    state.keys.erase(key);
+    updateCachedSymbols(state, key, -1);
+  }
+}
+
+RatelessEncoder::State&
+RatelessEncoder::getOwnState()
+{
+  if (m_state.use_count() > 1) {
+    m_state = std::make_shared<State>(*m_state);
+  }
+  return *m_state;
+}
+
+void
+RatelessEncoder::updateCachedSymbols(State& state, uint64_t key, int32_t count)
+{
+  uint32_t check = hashKey(N_HASHCHECK, key, m_keyWidth);
+  for (SymbolMapping mapping(key, m_keyWidth); mapping.getIndex() < state.cachedSymbols.size();
+       mapping.next()) {
+    HashTableEntry& symbol = state.cachedSymbols[mapping.getIndex()];
+    symbol.count += count;
+    symbol.keySum ^= key;
+    symbol.keyCheck ^= check;
+  }
+}
+
+std::vector<HashTableEntry>
+RatelessEncoder::getSymbols(size_t nSymbols) const
+{
+  const auto& cachedSymbols = m_state->cachedSymbols;
+  if (nSymbols <= cachedSymbols.size()) {
+    return std::vector<HashTableEntry>(cachedSymbols.begin(), cachedSymbols.begin() + nSymbols);
+  }
+
+  std::vector<HashTableEntry> symbols(nSymbols, HashTableEntry{0, 0, 0});
+  for (uint64_t key : m_state->keys) {
+    uint32_t check = hashKey(N_HASHCHECK, key, m_keyWidth);
+    for (SymbolMapping mapping(key, m_keyWidth); mapping.getIndex() < nSymbols; mapping.next()) {
+      HashTableEntry& symbol = symbols[mapping.getIndex()];
+      symbol.count += 1;
+      symbol.keySum ^= key;
+      symbol.keyCheck ^= check;
+    }
+  }
+  return symbols;
+}
+
+ndn::Block
+RatelessEncoder::wireEncode(size_t nSymbols) const
+{
+  size_t keySize = static_cast<size_t>(m_keyWidth) / 8;
+  std::vector<uint8_t> value;
+  value.reserve(1 + nSymbols * getSymbolSize(m_keyWidth));
+  value.push_back(static_cast<uint8_t>(m_keyWidth));
+  for (const auto& symbol : getSymbols(nSymbols)) {
+    appendUint(value, static_cast<uint32_t>(symbol.count), sizeof(uint32_t));
+    appendUint(value, symbol.keySum, keySize);
+    appendUint(value, symbol.keyCheck, sizeof(uint32_t));
+  }
+
+  auto wire = std::make_shared<ndn::Buffer>();
+  appendVarNumber(*wire, tlv::PSyncCodedSymbols);
+  appendVarNumber(*wire, value.size());
+  wire->insert(wire->end(), value.begin(), value.end());
+  return ndn::Block(wire);
+}
+
+RatelessDecoder::RatelessDecoder(const RatelessEncoder& local)
+  : m_keyWidth(local.m_keyWidth)
+  , m_local(local.m_state)
+  , m_nLocalSymbols(local.m_state->cachedSymbols.size())
+{
+}
+
+void
+RatelessDecoder::mapLocalKeys()
+{
+  for (uint64_t key : m_local->keys) {
+    MappedKey mappedKey{SymbolMapping(key, m_keyWidth), key,
+                        hashKey(N_HASHCHECK, key, m_keyWidth), -1};
+    while (mappedKey.mapping.getIndex() < m_nLocalSymbols) {
+      mappedKey.mapping.next();
+    }
+    m_mappedKeys.push(mappedKey);
+  }
+  m_local.reset();
+}
+
+void
+RatelessDecoder::addSymbol(const HashTableEntry& symbol)
+{
+  size_t index = m_symbols.size();
+  HashTableEntry difference = symbol;
+  if (index < m_nLocalSymbols) {
+    const HashTableEntry& local = m_local->cachedSymbols[index];
+    difference.count -= local.count;
+    difference.keySum ^= local.keySum;
+    difference.keyCheck ^= local.keyCheck;
+  }
+  else if (index == m_nLocalSymbols) {
+    mapLocalKeys();
+  }
+  while (!m_mappedKeys.empty() && m_mappedKeys.top().mapping.getIndex() == index) {
+    MappedKey mappedKey = m_mappedKeys.top();
+    m_mappedKeys.pop();
+    difference.count += mappedKey.count;
+    difference.keySum ^= mappedKey.key;
+    difference.keyCheck ^= mappedKey.check;
+    mappedKey.mapping.next();
+    m_mappedKeys.push(mappedKey);
+  }
+
+  m_symbols.push_back(difference);
+  if (difference.isPure(m_keyWidth)) {
+    m_pureSymbols.push_back(index);
+    peel();
+  }
+}
+
+void
+RatelessDecoder::peel()
+{
+  while (!m_pureSymbols.empty()) {
+    size_t index = m_pureSymbols.back();
+    const HashTableEntry& symbol = m_symbols[index];
+    m_pureSymbols.pop_back();
+    if (!symbol.isPure(m_keyWidth)) {
+      continue;
+    }
+
+    // Several keys can pass the check by chance, but then their sum is hardly
+    // a key that is mapped to this coded symbol
+    uint64_t key = symbol.keySum;
+    SymbolMapping mapping(key, m_keyWidth);
+    while (mapping.getIndex() < index) {
+      mapping.next();
+    }
+    if (mapping.getIndex() != index) {
+      continue;
+    }
+
+    MappedKey mappedKey{SymbolMapping(key, m_keyWidth), key, symbol.keyCheck, -symbol.count};
+    if (symbol.count == 1) {
+      m_remoteOnly.insert(key);
+    }
+    else {
+      m_localOnly.insert(key);
+    }
+
+    // Remove the key from the symbols received so far, and from the later ones as they come
+    for (; mappedKey.mapping.getIndex() < m_symbols.size(); mappedKey.mapping.next()) {
+      HashTableEntry& mapped = m_symbols[mappedKey.mapping.getIndex()];
+      mapped.count += mappedKey.count;
+      mapped.keySum ^= mappedKey.key;
+      mapped.keyCheck ^= mappedKey.check;
+      if (mapped.isPure(m_keyWidth)) {
+        m_pureSymbols.push_back(mappedKey.mapping.getIndex());
+      }
+    }
+    m_mappedKeys.push(mappedKey);
+  }
+}
+
+bool
+RatelessDecoder::isDecoded() const
+{
+  // Every key is mapped to the first coded symbol
+  return !m_symbols.empty() && m_symbols.front().isEmpty();
+}
+
+void
+RatelessDecoder::addEncodedBytes(const uint8_t* begin, const uint8_t* end)
+{
+  m_pending.insert(m_pending.end(), begin, end);
+
+  if (!m_hasHeader) {
+    const uint8_t* pos = m_pending.data();
+    const uint8_t* pendingEnd = pos + m_pending.size();
+    uint64_t type = 0;
+    uint64_t length = 0;
+    if (!readVarNumber(pos, pendingEnd, type) || !readVarNumber(pos, pendingEnd, length) ||
+        pos == pendingEnd) {
+      return;
+    }
+    if (type != tlv::PSyncCodedSymbols || length == 0) {
+      BOOST_THROW_EXCEPTION(Error("Received coded symbols cannot be decoded!"));
+    }
+    if (*pos != static_cast<uint8_t>(m_keyWidth)) {
+      BOOST_THROW_EXCEPTION(Error("Received coded symbols have a different key width!"));
+    }
+    ++pos;
+    m_hasHeader = true;
+    m_remainingBytes = length - 1;
+    m_pending.erase(m_pending.begin(), m_pending.begin() + (pos - m_pending.data()));
+  }
+
+  addEncodedSymbols();
+}
+
+void
+RatelessDecoder::addEncodedSymbols()
+{
+  size_t symbolSize = getSymbolSize(m_keyWidth);
+  size_t keySize = static_cast<size_t>(m_keyWidth) / 8;
+  if (m_remainingBytes % symbolSize != 0) {
+    BOOST_THROW_EXCEPTION(Error("Received coded symbols cannot be decoded!"));
+  }
+
+  size_t offset = 0;
+  while (m_remainingBytes > 0 && m_pending.size() - offset >= symbolSize) {
+    const uint8_t* pos = m_pending.data() + offset;
+    HashTableEntry symbol;
+    symbol.count = static_cast<int32_t>(readUint(pos, sizeof(uint32_t)));
+    symbol.keySum = readUint(pos + sizeof(uint32_t), keySize);
+    symbol.keyCheck = static_cast<uint32_t>(readUint(pos + sizeof(uint32_t) + keySize,
+                                                     sizeof(uint32_t)));
+    addSymbol(symbol);
+    offset += symbolSize;
+    m_remainingBytes -= symbolSize;
+  }
+
+  if (m_remainingBytes == 0) {
+    m_pending.clear();
+  }
+  else {
+    m_pending.erase(m_pending.begin(), m_pending.begin() + offset);
+  }
+}
+
+} // namespace psync
@@ -0,0 +1,271 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014-2019,  The University of Memphis
+ *
+ * This file is part of PSync.
+ * See AUTHORS.md for complete list of PSync authors and contributors.
+ *
+ * PSync is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU Lesser General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * PSync is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along with
+ * PSync, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PSYNC_RATELESS_IBLT_HPP
+#define PSYNC_RATELESS_IBLT_HPP
+
+#include "PSync/detail/iblt.hpp"
+
+#include <ndn-cxx/encoding/block.hpp>
+
+#include <memory>
+#include <queue>
+#include <set>
+#include <vector>
+
+namespace psync {
+
+/**
+ * @brief Indexes of the coded symbols a key is mapped to
+ *
+ * Every key is mapped to coded symbol 0; after that the gaps grow so that
+ * a key is mapped to coded symbol i with probability about 1/(1 + i/2)
+ * (Yang et al., "Practical Rateless Set Reconciliation").
+ */
+class SymbolMapping
+{
+public:
+  SymbolMapping(uint64_t key, KeyWidth keyWidth);
+
+  uint64_t
+  getIndex() const
+  {
+    return m_index;
+  }
+
+  /**
+   * @brief Move to the next coded symbol the key is mapped to
+   */
+  void
+  next();
+
+private:
+  uint64_t m_prng;
+  uint64_t m_index;
+};
+
+/**
+ * @brief Encoder of a set into a rateless sequence of coded symbols
+ *
+ * Unlike an IBLT, whose size must be chosen before the difference is known,
+ * the sequence of coded symbols is unbounded: any prefix of it can be decoded
+ * (see RatelessDecoder) once it is long enough for the difference, which takes
+ * about 1.35 to 2 coded symbols per differing key.  The coded symbols have the
+ * same cells as the IBLT (count, sum and check hash of the keys).
+ *
+ * Copies of an encoder, and the decoders made from it, share its keys and cached
+ * coded symbols until one of the encoders is modified.
+ */
+class RatelessEncoder
+{
+public:
+  /**
+   * @param keyWidth width of the keys, must be the same as the one of the decoder
+   * @param nCachedSymbols number of first coded symbols that are kept up to date as keys
+   *        are inserted and erased, so that getting them and decoding against them
+   *        does not map every key again
+   */
+  explicit
+  RatelessEncoder(KeyWidth keyWidth = KeyWidth::DEFAULT, size_t nCachedSymbols = 0);
+
+  void
+  insert(uint64_t key);
+
+  void
+  erase(uint64_t key);
+
+  KeyWidth
+  getKeyWidth() const
+  {
+    return m_keyWidth;
+  }
+
+  /**
+   * @brief Get the first nSymbols coded symbols
+   */
+  std::vector<HashTableEntry>
+  getSymbols(size_t nSymbols) const;
+
+  /**
+   * @brief Encode the first nSymbols coded symbols
+   *
+   * The block (of type tlv::PSyncCodedSymbols) holds the key width in one byte,
+   * followed by the coded symbols, each a fixed-size record of the count, the key
+   * sum (4 or 8 bytes) and the check hash, in little endian byte order.  So the
+   * encoding can be decoded piecewise as its segments arrive.
+   */
+  ndn::Block
+  wireEncode(size_t nSymbols) const;
+
+private:
+  struct State
+  {
+    std::set<uint64_t> keys;
+    // The first nCachedSymbols coded symbols of keys
+    std::vector<HashTableEntry> cachedSymbols;
+  };
+
+  /**
+   * @brief Get m_state to modify it, copying it first if others still share it
+   */
+  State&
+  getOwnState();
+
+  /**
+   * @brief Add (count 1) or remove (count -1) key to or from the cached coded symbols
+   */
+  void
+  updateCachedSymbols(State& state, uint64_t key, int32_t count);
+
+private:
+  KeyWidth m_keyWidth;
+  std::shared_ptr<State> m_state;
+
+  friend class RatelessDecoder;
+};
+
+/**
+ * @brief Incremental decoder of the difference between a remote set, given as
+ *        its coded symbols, and a local set
+ *
+ * Each coded symbol is peeled as soon as it is added, so the decoder can tell
+ * when enough of the remote sequence has been received.
+ */
+class RatelessDecoder
+{
+public:
+  class Error : public std::runtime_error
+  {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  /**
+   * @param local encoder of the local set, whose coded symbols are subtracted
+   *              from the remote ones.  Its cached coded symbols are subtracted
+   *              as they are; only if more remote coded symbols are added are
+   *              the local keys mapped to the later ones.  Nothing is copied:
+   *              the decoder keeps the set as it is now, even if local is modified
+   *              or destroyed later.
+   */
+  explicit
+  RatelessDecoder(const RatelessEncoder& local);
+
+  /**
+   * @brief Add the next coded symbol of the remote set
+   */
+  void
+  addSymbol(const HashTableEntry& symbol);
+
+  /**
+   * @brief Add the next part of the wire encoding of the remote coded symbols
+   *
+   * The parts (e.g., the contents of the segments of the data carrying
+   * RatelessEncoder::wireEncode) must be added in order but may split the
+   * encoding anywhere.  Bytes past the end of the encoding are ignored.
+   *
+   * @throws Error if the encoding is malformed or has a different key width
+   */
+  void
+  addEncodedBytes(const uint8_t* begin, const uint8_t* end);
+
+  /**
+   * @brief Whether the difference has been decoded completely
+   */
+  bool
+  isDecoded() const;
+
+  size_t
+  getNumSymbols() const
+  {
+    return m_symbols.size();
+  }
+
+  /**
+   * @brief Keys that are in the remote set only (decoded so far)
+   */
+  const std::set<uint64_t>&
+  getRemoteOnly() const
+  {
+    return m_remoteOnly;
+  }
+
+  /**
+   * @brief Keys that are in the local set only (decoded so far)
+   */
+  const std::set<uint64_t>&
+  getLocalOnly() const
+  {
+    return m_localOnly;
+  }
+
+private:
+  // A key whose contribution is added to the coded symbols it is mapped to
+  struct MappedKey
+  {
+    SymbolMapping mapping;
+    uint64_t key;
+    uint32_t check;
+    int32_t count;
+
+    bool
+    operator>(const MappedKey& other) const
+    {
+      return mapping.getIndex() > other.mapping.getIndex();
+    }
+  };
+
+  using MappedKeyQueue = std::priority_queue<MappedKey, std::vector<MappedKey>,
+                                             std::greater<MappedKey>>;
+
+  void
+  peel();
+
+  /**
+   * @brief Map the local keys to the coded symbols after the cached local ones,
+   *        and let go of the local set
+   */
+  void
+  mapLocalKeys();
+
+  void
+  addEncodedSymbols();
+
+private:
+  KeyWidth m_keyWidth;
+  // The local set: its first coded symbols, and its keys for the coded symbols after them
+  std::shared_ptr<const RatelessEncoder::State> m_local;
+  size_t m_nLocalSymbols;
+  // Keys of the local set past its first coded symbols (count -1) and decoded keys
+  // (count opposite to the decoded one), ordered by the next coded symbol they are mapped to
+  MappedKeyQueue m_mappedKeys;
+  std::vector<HashTableEntry> m_symbols;
+  std::vector<size_t> m_pureSymbols;
+  std::set<uint64_t> m_remoteOnly;
+  std::set<uint64_t> m_localOnly;
+
+  // State of addEncodedBytes
+  std::vector<uint8_t> m_pending;
+  bool m_hasHeader = false;
+  size_t m_remainingBytes = 0;
+};
+
+} // namespace psync
+
+#endif // PSYNC_RATELESS_IBLT_HPP
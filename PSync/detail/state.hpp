@@ -27,7 +27,8 @@ namespace psync {
 namespace tlv {
 
 enum {
-  PSyncContent = 128
+  PSyncContent = 128,
+  PSyncCodedSymbols = 129
 };
 
 } // namespace tlv
@@ -0,0 +1,131 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014-2019,  The University of Memphis
+ *
+ * This file is part of PSync.
+ * See AUTHORS.md for complete list of PSync authors and contributors.
+ *
+ * PSync is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU Lesser General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * PSync is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along with
+ * PSync, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "PSync/detail/strata-estimator.hpp"
+
+#include <algorithm>
+
+namespace psync {
+
+// 16 strata of 30 cells tell apart differences up to tens of thousands
+// while keeping the encoding small enough to fit in a sync interest
+const size_t N_STRATA = 16;
+const size_t STRATUM_ENTRIES = 20;
+
+StrataEstimator::StrataEstimator(KeyWidth keyWidth)
+  : m_keyWidth(keyWidth)
+  , m_strata(N_STRATA, IBLT(STRATUM_ENTRIES, CompressionScheme::NONE, keyWidth))
+{
+}
+
+size_t
+StrataEstimator::getStratum(uint64_t key) const
+{
+  size_t stratum = 0;
+  while (stratum < m_strata.size() - 1 && (key & 1) == 0) {
+    key >>= 1;
+    ++stratum;
+  }
+  return stratum;
+}
+
+void
+StrataEstimator::insert(uint64_t key)
+{
+  m_strata[getStratum(key)].insert(key);
+}
+
+void
+StrataEstimator::erase(uint64_t key)
+{
+  m_strata[getStratum(key)].erase(key);
+}
+
+size_t
+StrataEstimator::estimateDifference(const StrataEstimator& other) const
+{
+  size_t count = 0;
+  DecodeScratch scratch;
+  std::vector<uint64_t> positive;
+  std::vector<uint64_t> negative;
+  for (size_t i = m_strata.size(); i-- > 0;) {
+    if (m_strata[i].decodeDifference(other.m_strata[i], scratch, positive, negative) !=
+        DecodeResult::SUCCESS) {
+      // Stratum i and the ones below it together hold 2^(i+1) times
+      // as many keys as the strata above it
+      return (size_t(2) << i) * std::max<size_t>(count, 1);
+    }
+    count += positive.size() + negative.size();
+  }
+  return count;
+}
+
+void
+StrataEstimator::appendToName(ndn::Name& name) const
+{
+  std::vector<uint8_t> value;
+  value.push_back(static_cast<uint8_t>(m_strata.size()));
+  for (const auto& stratum : m_strata) {
+    const ndn::name::Component& encoded = stratum.getEncoded();
+    value.push_back(0xFF & (encoded.value_size() >> 8));
+    value.push_back(0xFF & encoded.value_size());
+    value.insert(value.end(), encoded.value_begin(), encoded.value_end());
+  }
+  name.append(value.begin(), value.end());
+}
+
+void
+StrataEstimator::initialize(const ndn::name::Component& component)
+{
+  const uint8_t* pos = component.value_begin();
+  const uint8_t* end = component.value_end();
+
+  if (pos == end || *pos != m_strata.size()) {
+    BOOST_THROW_EXCEPTION(Error("Received strata estimator cannot be decoded!"));
+  }
+  ++pos;
+
+  std::vector<IBLT> strata(m_strata.size(),
+                           IBLT(STRATUM_ENTRIES, CompressionScheme::NONE, m_keyWidth));
+  for (auto& stratum : strata) {
+    if (end - pos < 2) {
+      BOOST_THROW_EXCEPTION(Error("Received strata estimator cannot be decoded!"));
+    }
+    size_t length = (static_cast<size_t>(pos[0]) << 8) + pos[1];
+    pos += 2;
+    if (static_cast<size_t>(end - pos) < length) {
+      BOOST_THROW_EXCEPTION(Error("Received strata estimator cannot be decoded!"));
+    }
+
+    try {
+      stratum.initialize(ndn::name::Component(pos, pos + length));
+    }
+    catch (const std::exception&) {
+      BOOST_THROW_EXCEPTION(Error("Received strata estimator cannot be decoded!"));
+    }
+    pos += length;
+  }
+
+  if (pos != end) {
+    BOOST_THROW_EXCEPTION(Error("Received strata estimator cannot be decoded!"));
+  }
+  m_strata = std::move(strata);
+}
+
+} // namespace psync
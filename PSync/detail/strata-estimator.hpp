@@ -0,0 +1,100 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014-2019,  The University of Memphis
+ *
+ * This file is part of PSync.
+ * See AUTHORS.md for complete list of PSync authors and contributors.
+ *
+ * PSync is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU Lesser General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * PSync is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along with
+ * PSync, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PSYNC_STRATA_ESTIMATOR_HPP
+#define PSYNC_STRATA_ESTIMATOR_HPP
+
+#include "PSync/detail/iblt.hpp"
+
+#include <ndn-cxx/name.hpp>
+
+#include <vector>
+
+namespace psync {
+
+/**
+ * @brief Strata estimator for the size of the difference between two sets
+ *
+ * Keys are partitioned into strata by the number of trailing zeros in the key,
+ * so stratum i holds about 1/2^(i+1) of the keys.  Each stratum is a small IBLT.
+ * The difference is estimated by decoding the strata from the sparsest one down
+ * and scaling the number of differences found when a stratum fails to decode
+ * (Eppstein et al., "What's the Difference? Efficient Set Reconciliation without
+ * Prior Context").
+ *
+ * The keys are expected to be hashes (as the keys of the IBLT are),
+ * so their trailing zeros are uniformly distributed.
+ */
+class StrataEstimator
+{
+public:
+  class Error : public std::runtime_error
+  {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  /**
+   * @param keyWidth width of the keys, must be the same as the one of the other estimators
+   */
+  explicit
+  StrataEstimator(KeyWidth keyWidth = KeyWidth::DEFAULT);
+
+  /**
+   * @brief Populate the estimator from its name component representation
+   *
+   * @param component the component appended by appendToName
+   * @throws Error if the component cannot be decoded
+   */
+  void
+  initialize(const ndn::name::Component& component);
+
+  void
+  insert(uint64_t key);
+
+  void
+  erase(uint64_t key);
+
+  /**
+   * @brief Estimate the number of keys that are in only one of the two estimators
+   */
+  size_t
+  estimateDifference(const StrataEstimator& other) const;
+
+  /**
+   * @brief Appends self to name
+   *
+   * The component holds the number of strata followed by the encoding of each
+   * stratum (see IBLT::appendToName) preceded by its 2-byte length.
+   */
+  void
+  appendToName(ndn::Name& name) const;
+
+private:
+  size_t
+  getStratum(uint64_t key) const;
+
+private:
+  KeyWidth m_keyWidth;
+  std::vector<IBLT> m_strata;
+};
+
+} // namespace psync
+
+#endif // PSYNC_STRATA_ESTIMATOR_HPP
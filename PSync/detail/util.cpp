@@ -23,10 +23,32 @@
 
 #include "PSync/detail/util.hpp"
 
+#include <ndn-cxx/encoding/buffer-stream.hpp>
 #include <ndn-cxx/util/backports.hpp>
 
+#include <boost/endian/conversion.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#ifdef PSYNC_HAVE_BZIP2
+#include <boost/iostreams/filter/bzip2.hpp>
+#endif
+#ifdef PSYNC_HAVE_LZMA
+#include <boost/iostreams/filter/lzma.hpp>
+#endif
+#ifdef PSYNC_HAVE_ZSTD
+#include <boost/iostreams/filter/zstd.hpp>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
 namespace psync {
 
+namespace bio = boost::iostreams;
+
 static uint32_t
 ROTL32 ( uint32_t x, int8_t r )
 {
@@ -34,20 +56,19 @@ ROTL32 ( uint32_t x, int8_t r )
 }
 
 uint32_t
-murmurHash3(uint32_t nHashSeed, const std::vector<unsigned char>& vDataToHash)
+murmurHash3(uint32_t nHashSeed, const uint8_t* data, size_t size)
 {
   uint32_t h1 = nHashSeed;
   const uint32_t c1 = 0xcc9e2d51;
   const uint32_t c2 = 0x1b873593;
 
-  const size_t nblocks = vDataToHash.size() / 4;
+  const size_t nblocks = size / 4;
 
   //----------
   // body
-  const uint32_t * blocks = (const uint32_t *)(&vDataToHash[0] + nblocks*4);
-
-  for (size_t i = -nblocks; i; i++) {
-    uint32_t k1 = blocks[i];
+  for (size_t i = 0; i < nblocks; i++) {
+    uint32_t k1;
+    std::memcpy(&k1, data + i*4, sizeof(k1));
 
     k1 *= c1;
     k1 = ROTL32(k1,15);
@@ -60,11 +81,11 @@ murmurHash3(uint32_t nHashSeed, const std::vector<unsigned char>& vDataToHash)
 
   //----------
   // tail
-  const uint8_t * tail = (const uint8_t*)(&vDataToHash[0] + nblocks*4);
+  const uint8_t * tail = data + nblocks*4;
 
   uint32_t k1 = 0;
 
-  switch (vDataToHash.size() & 3) {
+  switch (size & 3) {
     case 3:
       k1 ^= tail[2] << 16;
       NDN_CXX_FALLTHROUGH;
@@ -80,7 +101,7 @@ murmurHash3(uint32_t nHashSeed, const std::vector<unsigned char>& vDataToHash)
 
   //----------
   // finalization
-  h1 ^= vDataToHash.size();
+  h1 ^= size;
   h1 ^= h1 >> 16;
   h1 *= 0x85ebca6b;
   h1 ^= h1 >> 13;
@@ -90,18 +111,409 @@ murmurHash3(uint32_t nHashSeed, const std::vector<unsigned char>& vDataToHash)
   return h1;
 }
 
-uint32_t
-murmurHash3(uint32_t nHashSeed, const std::string& str)
+// Seeds hashed together by the multi-seed murmurHash3, enough for a vector
+// register of 32-bit lanes on common CPUs (two for SSE, one for AVX2)
+const size_t MULTI_SEED_LANES = 8;
+
+void
+murmurHash3(const uint32_t* seeds, size_t nSeeds, const uint8_t* data, size_t size,
+            uint32_t* hashes)
 {
-  return murmurHash3(nHashSeed, std::vector<unsigned char>(str.begin(), str.end()));
+  const uint32_t c1 = 0xcc9e2d51;
+  const uint32_t c2 = 0x1b873593;
+
+  const size_t nblocks = size / 4;
+  const uint8_t * tail = data + nblocks*4;
+
+  // Mixing a block does not depend on the seed, so it is done once per group of seeds,
+  // then the state of every seed of the group is updated.  The group has a fixed size
+  // and its updates are independent of each other, so the compiler can vectorize them.
+  for (size_t first = 0; first < nSeeds; first += MULTI_SEED_LANES) {
+    size_t nLanes = std::min(MULTI_SEED_LANES, nSeeds - first);
+    uint32_t h1[MULTI_SEED_LANES] = {};
+    std::copy_n(seeds + first, nLanes, h1);
+
+    //----------
+    // body
+    for (size_t i = 0; i < nblocks; i++) {
+      uint32_t k1;
+      std::memcpy(&k1, data + i*4, sizeof(k1));
+
+      k1 *= c1;
+      k1 = ROTL32(k1,15);
+      k1 *= c2;
+
+      for (size_t j = 0; j < MULTI_SEED_LANES; j++) {
+        h1[j] ^= k1;
+        h1[j] = ROTL32(h1[j],13);
+        h1[j] = h1[j]*5+0xe6546b64;
+      }
+    }
+
+    //----------
+    // tail
+    uint32_t k1 = 0;
+
+    switch (size & 3) {
+      case 3:
+        k1 ^= tail[2] << 16;
+        NDN_CXX_FALLTHROUGH;
+
+      case 2:
+        k1 ^= tail[1] << 8;
+        NDN_CXX_FALLTHROUGH;
+
+      case 1:
+        k1 ^= tail[0];
+        k1 *= c1; k1 = ROTL32(k1,15); k1 *= c2;
+    }
+
+    //----------
+    // finalization
+    for (size_t j = 0; j < MULTI_SEED_LANES; j++) {
+      h1[j] ^= k1;
+      h1[j] ^= size;
+      h1[j] ^= h1[j] >> 16;
+      h1[j] *= 0x85ebca6b;
+      h1[j] ^= h1[j] >> 13;
+      h1[j] *= 0xc2b2ae35;
+      h1[j] ^= h1[j] >> 16;
+    }
+
+    std::copy_n(h1, nLanes, hashes + first);
+  }
 }
 
-uint32_t
-murmurHash3(uint32_t nHashSeed, uint32_t value)
+static uint64_t
+ROTL64 ( uint64_t x, int8_t r )
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t
+fmix64 ( uint64_t k )
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+uint64_t
+murmurHash3x64(uint32_t nHashSeed, const uint8_t* data, size_t size)
+{
+  uint64_t h1 = nHashSeed;
+  uint64_t h2 = nHashSeed;
+  const uint64_t c1 = 0x87c37b91114253d5ULL;
+  const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+  const size_t nblocks = size / 16;
+
+  //----------
+  // body
+  for (size_t i = 0; i < nblocks; i++) {
+    uint64_t k1, k2;
+    std::memcpy(&k1, data + i*16, sizeof(k1));
+    std::memcpy(&k2, data + i*16 + 8, sizeof(k2));
+
+    k1 *= c1; k1 = ROTL64(k1,31); k1 *= c2; h1 ^= k1;
+
+    h1 = ROTL64(h1,27); h1 += h2; h1 = h1*5+0x52dce729;
+
+    k2 *= c2; k2 = ROTL64(k2,33); k2 *= c1; h2 ^= k2;
+
+    h2 = ROTL64(h2,31); h2 += h1; h2 = h2*5+0x38495ab5;
+  }
+
+  //----------
+  // tail
+  const uint8_t * tail = data + nblocks*16;
+
+  uint64_t k1 = 0;
+  uint64_t k2 = 0;
+
+  switch (size & 15) {
+    case 15: k2 ^= uint64_t(tail[14]) << 48; NDN_CXX_FALLTHROUGH;
+    case 14: k2 ^= uint64_t(tail[13]) << 40; NDN_CXX_FALLTHROUGH;
+    case 13: k2 ^= uint64_t(tail[12]) << 32; NDN_CXX_FALLTHROUGH;
+    case 12: k2 ^= uint64_t(tail[11]) << 24; NDN_CXX_FALLTHROUGH;
+    case 11: k2 ^= uint64_t(tail[10]) << 16; NDN_CXX_FALLTHROUGH;
+    case 10: k2 ^= uint64_t(tail[ 9]) << 8; NDN_CXX_FALLTHROUGH;
+    case  9: k2 ^= uint64_t(tail[ 8]) << 0;
+             k2 *= c2; k2 = ROTL64(k2,33); k2 *= c1; h2 ^= k2;
+             NDN_CXX_FALLTHROUGH;
+
+    case  8: k1 ^= uint64_t(tail[ 7]) << 56; NDN_CXX_FALLTHROUGH;
+    case  7: k1 ^= uint64_t(tail[ 6]) << 48; NDN_CXX_FALLTHROUGH;
+    case  6: k1 ^= uint64_t(tail[ 5]) << 40; NDN_CXX_FALLTHROUGH;
+    case  5: k1 ^= uint64_t(tail[ 4]) << 32; NDN_CXX_FALLTHROUGH;
+    case  4: k1 ^= uint64_t(tail[ 3]) << 24; NDN_CXX_FALLTHROUGH;
+    case  3: k1 ^= uint64_t(tail[ 2]) << 16; NDN_CXX_FALLTHROUGH;
+    case  2: k1 ^= uint64_t(tail[ 1]) << 8; NDN_CXX_FALLTHROUGH;
+    case  1: k1 ^= uint64_t(tail[ 0]) << 0;
+             k1 *= c1; k1 = ROTL64(k1,31); k1 *= c2; h1 ^= k1;
+  }
+
+  //----------
+  // finalization
+  h1 ^= size;
+  h2 ^= size;
+
+  h1 += h2;
+  h2 += h1;
+
+  h1 = fmix64(h1);
+  h2 = fmix64(h2);
+
+  h1 += h2;
+
+  return h1;
+}
+
+static uint64_t
+readWy8(const uint8_t* p)
+{
+  uint64_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return boost::endian::little_to_native(value);
+}
+
+static uint64_t
+readWy4(const uint8_t* p)
 {
-  return murmurHash3(nHashSeed,
-                     std::vector<unsigned char>((unsigned char*)&value,
-                                                (unsigned char*)&value + sizeof(uint32_t)));
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return boost::endian::little_to_native(value);
+}
+
+static uint64_t
+readWy3(const uint8_t* p, size_t size)
+{
+  return (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[size >> 1]) << 8) |
+         p[size - 1];
+}
+
+uint64_t
+wyhash(uint64_t seed, const uint8_t* data, size_t size)
+{
+  const uint64_t* secret = WYHASH_SECRET;
+  const uint8_t* p = data;
+  seed ^= wyMix(seed ^ secret[0], secret[1]);
+
+  uint64_t a, b;
+  if (size <= 16) {
+    if (size >= 4) {
+      a = (readWy4(p) << 32) | readWy4(p + ((size >> 3) << 2));
+      b = (readWy4(p + size - 4) << 32) | readWy4(p + size - 4 - ((size >> 3) << 2));
+    }
+    else if (size > 0) {
+      a = readWy3(p, size);
+      b = 0;
+    }
+    else {
+      a = b = 0;
+    }
+  }
+  else {
+    size_t i = size;
+    if (i > 48) {
+      uint64_t seed1 = seed, seed2 = seed;
+      do {
+        seed = wyMix(readWy8(p) ^ secret[1], readWy8(p + 8) ^ seed);
+        seed1 = wyMix(readWy8(p + 16) ^ secret[2], readWy8(p + 24) ^ seed1);
+        seed2 = wyMix(readWy8(p + 32) ^ secret[3], readWy8(p + 40) ^ seed2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= seed1 ^ seed2;
+    }
+    while (i > 16) {
+      seed = wyMix(readWy8(p) ^ secret[1], readWy8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = readWy8(p + i - 16);
+    b = readWy8(p + i - 8);
+  }
+
+  a ^= secret[1];
+  b ^= seed;
+  wyMultiply(a, b);
+  return wyMix(a ^ secret[0] ^ size, b ^ secret[1]);
+}
+
+static std::shared_ptr<ndn::Buffer>
+filterBuffer(bio::filtering_streambuf<bio::input>& in, const uint8_t* buffer, size_t bufferSize)
+{
+  in.push(bio::array_source(reinterpret_cast<const char*>(buffer), bufferSize));
+
+  ndn::OBufferStream out;
+  try {
+    bio::copy(in, out);
+  }
+  catch (const std::ios_base::failure& e) {
+    BOOST_THROW_EXCEPTION(CompressionError(e.what()));
+  }
+  return out.buf();
+}
+
+std::shared_ptr<ndn::Buffer>
+compress(CompressionScheme scheme, const uint8_t* buffer, size_t bufferSize)
+{
+  bio::filtering_streambuf<bio::input> in;
+
+  switch (scheme) {
+    case CompressionScheme::NONE:
+      return std::make_shared<ndn::Buffer>(buffer, buffer + bufferSize);
+
+    case CompressionScheme::ZLIB:
+      in.push(bio::zlib_compressor());
+      break;
+
+    case CompressionScheme::GZIP:
+      in.push(bio::gzip_compressor());
+      break;
+
+    case CompressionScheme::BZIP2:
+#ifdef PSYNC_HAVE_BZIP2
+      in.push(bio::bzip2_compressor());
+      break;
+#else
+      BOOST_THROW_EXCEPTION(CompressionError("BZIP2 compression not supported!"));
+#endif
+
+    case CompressionScheme::LZMA:
+#ifdef PSYNC_HAVE_LZMA
+      in.push(bio::lzma_compressor());
+      break;
+#else
+      BOOST_THROW_EXCEPTION(CompressionError("LZMA compression not supported!"));
+#endif
+
+    case CompressionScheme::ZSTD:
+#ifdef PSYNC_HAVE_ZSTD
+      in.push(bio::zstd_compressor());
+      break;
+#else
+      BOOST_THROW_EXCEPTION(CompressionError("ZSTD compression not supported!"));
+#endif
+
+    default:
+      BOOST_THROW_EXCEPTION(CompressionError("Unknown compression scheme!"));
+  }
+
+  return filterBuffer(in, buffer, bufferSize);
+}
+
+// Adds the decompressor for scheme, which must not be NONE, to the chain
+static void
+pushDecompressor(bio::filtering_streambuf<bio::input>& in, CompressionScheme scheme)
+{
+  switch (scheme) {
+    case CompressionScheme::ZLIB:
+      in.push(bio::zlib_decompressor());
+      break;
+
+    case CompressionScheme::GZIP:
+      in.push(bio::gzip_decompressor());
+      break;
+
+    case CompressionScheme::BZIP2:
+#ifdef PSYNC_HAVE_BZIP2
+      in.push(bio::bzip2_decompressor());
+      break;
+#else
+      BOOST_THROW_EXCEPTION(CompressionError("BZIP2 compression not supported!"));
+#endif
+
+    case CompressionScheme::LZMA:
+#ifdef PSYNC_HAVE_LZMA
+      in.push(bio::lzma_decompressor());
+      break;
+#else
+      BOOST_THROW_EXCEPTION(CompressionError("LZMA compression not supported!"));
+#endif
+
+    case CompressionScheme::ZSTD:
+#ifdef PSYNC_HAVE_ZSTD
+      in.push(bio::zstd_decompressor());
+      break;
+#else
+      BOOST_THROW_EXCEPTION(CompressionError("ZSTD compression not supported!"));
+#endif
+
+    default:
+      BOOST_THROW_EXCEPTION(CompressionError("Unknown compression scheme!"));
+  }
+}
+
+std::shared_ptr<ndn::Buffer>
+decompress(CompressionScheme scheme, const uint8_t* buffer, size_t bufferSize)
+{
+  if (scheme == CompressionScheme::NONE) {
+    return std::make_shared<ndn::Buffer>(buffer, buffer + bufferSize);
+  }
+
+  bio::filtering_streambuf<bio::input> in;
+  pushDecompressor(in, scheme);
+  return filterBuffer(in, buffer, bufferSize);
+}
+
+DecompressingReader::DecompressingReader(CompressionScheme scheme,
+                                         const uint8_t* buffer, size_t bufferSize)
+  : m_pos(buffer)
+  , m_end(buffer + bufferSize)
+{
+  if (scheme != CompressionScheme::NONE) {
+    m_in = ndn::make_unique<bio::filtering_streambuf<bio::input>>();
+    pushDecompressor(*m_in, scheme);
+    m_in->push(bio::array_source(reinterpret_cast<const char*>(buffer), bufferSize));
+    m_pos = m_end = m_chunk;
+  }
+}
+
+DecompressingReader::~DecompressingReader() = default;
+
+bool
+DecompressingReader::refill(size_t size)
+{
+  if (m_in == nullptr) {
+    return false;
+  }
+
+  // Move what is left to the front of the chunk and decompress behind it
+  size_t nLeft = m_end - m_pos;
+  std::memmove(m_chunk, m_pos, nLeft);
+  m_pos = m_chunk;
+  m_end = m_chunk + nLeft;
+  while (static_cast<size_t>(m_end - m_pos) < size && m_end != m_chunk + CHUNK_SIZE) {
+    std::streamsize nRead = 0;
+    try {
+      size_t nFilled = m_end - m_chunk;
+      nRead = m_in->sgetn(reinterpret_cast<char*>(m_chunk + nFilled), CHUNK_SIZE - nFilled);
+    }
+    catch (const std::ios_base::failure& e) {
+      BOOST_THROW_EXCEPTION(CompressionError(e.what()));
+    }
+    if (nRead <= 0) {
+      break;
+    }
+    m_end += nRead;
+  }
+  return static_cast<size_t>(m_end - m_pos) >= size;
+}
+
+size_t
+DecompressingReader::skipAll()
+{
+  size_t nSkipped = 0;
+  while (fill(1)) {
+    nSkipped += m_end - m_pos;
+    m_pos = m_end;
+  }
+  return nSkipped;
 }
 
 } // namespace psync
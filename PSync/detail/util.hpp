@@ -24,7 +24,12 @@
 #ifndef PSYNC_UTIL_HPP
 #define PSYNC_UTIL_HPP
 
+#include "PSync/common.hpp"
+
 #include <ndn-cxx/name.hpp>
+#include <ndn-cxx/encoding/buffer.hpp>
+
+#include <boost/iostreams/filtering_streambuf.hpp>
 
 #include <inttypes.h>
 #include <vector>
@@ -32,14 +37,258 @@
 
 namespace psync {
 
+/**
+ * @brief murmurHash3 (x86 32-bit variant) of size bytes at data
+ *
+ * Blocks of 4 bytes are read in host byte order.
+ */
 uint32_t
-murmurHash3(uint32_t nHashSeed, const std::vector<unsigned char>& vDataToHash);
+murmurHash3(uint32_t nHashSeed, const uint8_t* data, size_t size);
 
-uint32_t
-murmurHash3(uint32_t nHashSeed, const std::string& str);
+inline uint32_t
+murmurHash3(uint32_t nHashSeed, const std::vector<unsigned char>& vDataToHash)
+{
+  return murmurHash3(nHashSeed, vDataToHash.data(), vDataToHash.size());
+}
 
-uint32_t
-murmurHash3(uint32_t nHashSeed, uint32_t value);
+inline uint32_t
+murmurHash3(uint32_t nHashSeed, const std::string& str)
+{
+  return murmurHash3(nHashSeed, reinterpret_cast<const uint8_t*>(str.data()), str.size());
+}
+
+/**
+ * @brief murmurHash3 of size bytes at data with each of nSeeds seeds
+ *
+ * Same as hashes[i] = murmurHash3(seeds[i], data, size) for every seed,
+ * but reads and mixes the data once for all the seeds.
+ */
+void
+murmurHash3(const uint32_t* seeds, size_t nSeeds, const uint8_t* data, size_t size,
+            uint32_t* hashes);
+
+/**
+ * @brief murmurHash3 of the 4 bytes of value in host byte order
+ *
+ * Same as murmurHash3(nHashSeed, &value, 4), written out for the single block
+ * so that hashing an IBF key compiles down to a few multiplications.
+ */
+inline uint32_t
+murmurHash3(uint32_t nHashSeed, uint32_t value)
+{
+  uint32_t k1 = value * 0xcc9e2d51;
+  k1 = (k1 << 15) | (k1 >> 17);
+  k1 *= 0x1b873593;
+
+  uint32_t h1 = nHashSeed ^ k1;
+  h1 = (h1 << 13) | (h1 >> 19);
+  h1 = h1 * 5 + 0xe6546b64;
+
+  h1 ^= sizeof(value);
+  h1 ^= h1 >> 16;
+  h1 *= 0x85ebca6b;
+  h1 ^= h1 >> 13;
+  h1 *= 0xc2b2ae35;
+  h1 ^= h1 >> 16;
+  return h1;
+}
+
+/**
+ * @brief Lower 64 bits of the x64 128-bit variant of murmurHash3 of size bytes at data
+ */
+uint64_t
+murmurHash3x64(uint32_t nHashSeed, const uint8_t* data, size_t size);
+
+inline uint64_t
+murmurHash3x64(uint32_t nHashSeed, const std::vector<unsigned char>& vDataToHash)
+{
+  return murmurHash3x64(nHashSeed, vDataToHash.data(), vDataToHash.size());
+}
+
+inline uint64_t
+murmurHash3x64(uint32_t nHashSeed, const std::string& str)
+{
+  return murmurHash3x64(nHashSeed, reinterpret_cast<const uint8_t*>(str.data()), str.size());
+}
+
+/**
+ * @brief wyhash (final version 4, default secret) of size bytes at data
+ *
+ * Unlike murmurHash3, words are read in little endian byte order,
+ * so the hash of a name is the same on every host.
+ */
+uint64_t
+wyhash(uint64_t seed, const uint8_t* data, size_t size);
+
+inline uint64_t
+wyhash(uint64_t seed, const std::string& str)
+{
+  return wyhash(seed, reinterpret_cast<const uint8_t*>(str.data()), str.size());
+}
+
+/**
+ * @brief Replace a and b with the low and high 64 bits of their product
+ */
+inline void
+wyMultiply(uint64_t& a, uint64_t& b)
+{
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+  a = static_cast<uint64_t>(product);
+  b = static_cast<uint64_t>(product >> 64);
+#else
+  uint64_t aHigh = a >> 32, aLow = static_cast<uint32_t>(a);
+  uint64_t bHigh = b >> 32, bLow = static_cast<uint32_t>(b);
+  uint64_t high = aHigh * bHigh, middle0 = aHigh * bLow, middle1 = bHigh * aLow, low = aLow * bLow;
+  uint64_t t = low + (middle0 << 32);
+  uint64_t carry = t < low;
+  uint64_t productLow = t + (middle1 << 32);
+  carry += productLow < t;
+  a = productLow;
+  b = high + (middle0 >> 32) + (middle1 >> 32) + carry;
+#endif
+}
+
+inline uint64_t
+wyMix(uint64_t a, uint64_t b)
+{
+  wyMultiply(a, b);
+  return a ^ b;
+}
+
+const uint64_t WYHASH_SECRET[4] = {0x2d358dccaa6c78a5, 0x8bb84b93962eacc9,
+                                   0x4b33a62ed433d4a3, 0x4d5a2da51de1aa47};
+
+/**
+ * @brief wyhash of the 8 bytes of value in little endian byte order
+ *
+ * Same as wyhash(seed, bytes, 8), written out for a single 8-byte input
+ * so that hashing an IBF key compiles down to a few multiplications.
+ */
+inline uint64_t
+wyhash(uint64_t seed, uint64_t value)
+{
+  seed ^= wyMix(seed ^ WYHASH_SECRET[0], WYHASH_SECRET[1]);
+  // The two 4-byte halves of the input, high half first, then low half first
+  uint64_t a = ((value << 32) | (value >> 32)) ^ WYHASH_SECRET[1];
+  uint64_t b = value ^ seed;
+  wyMultiply(a, b);
+  return wyMix(a ^ WYHASH_SECRET[0] ^ sizeof(value), b ^ WYHASH_SECRET[1]);
+}
+
+/**
+ * @brief Hash of an IBF key with the given family
+ *
+ * murmurHash3 hashes the 4 or 8 bytes of the key in host byte order depending
+ * on the key width, wyhash hashes the key as a 64-bit value whatever the width.
+ */
+inline uint32_t
+hashKey(uint32_t nHashSeed, uint64_t key, KeyWidth keyWidth,
+        HashFamily hashFamily = HashFamily::DEFAULT)
+{
+  if (hashFamily == HashFamily::WYHASH) {
+    return static_cast<uint32_t>(wyhash(nHashSeed, key));
+  }
+  if (keyWidth == KeyWidth::BITS_32) {
+    return murmurHash3(nHashSeed, static_cast<uint32_t>(key));
+  }
+  return murmurHash3(nHashSeed, reinterpret_cast<const uint8_t*>(&key), sizeof(key));
+}
+
+class CompressionError : public std::runtime_error
+{
+public:
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief Compress buffer with the given scheme
+ *
+ * @throws CompressionError if the scheme is not supported by this build
+ */
+std::shared_ptr<ndn::Buffer>
+compress(CompressionScheme scheme, const uint8_t* buffer, size_t bufferSize);
+
+/**
+ * @brief Decompress buffer that was compressed with the given scheme
+ *
+ * @throws CompressionError if the scheme is not supported by this build
+ *         or the buffer cannot be decompressed
+ */
+std::shared_ptr<ndn::Buffer>
+decompress(CompressionScheme scheme, const uint8_t* buffer, size_t bufferSize);
+
+/**
+ * @brief Reader of a buffer compressed with the given scheme, which decompresses it
+ *        in chunks as it is read instead of all at once
+ *
+ * An uncompressed buffer is read in place.  A compressed one is decompressed into
+ * a chunk held by the reader, so that no buffer of the full decompressed size is needed.
+ */
+class DecompressingReader
+{
+public:
+  /**
+   * @throws CompressionError if the scheme is not supported by this build
+   */
+  DecompressingReader(CompressionScheme scheme, const uint8_t* buffer, size_t bufferSize);
+
+  ~DecompressingReader();
+
+  /**
+   * @brief Make at least size bytes, at most CHUNK_SIZE, available between pos() and end()
+   *
+   * @return false if the buffer ends first; the bytes that are left are still available
+   * @throws CompressionError if the buffer cannot be decompressed
+   */
+  bool
+  fill(size_t size)
+  {
+    return static_cast<size_t>(m_end - m_pos) >= size || refill(size);
+  }
+
+  /**
+   * @brief Read and drop the rest of the buffer
+   *
+   * @return number of bytes dropped
+   * @throws CompressionError if the buffer cannot be decompressed
+   */
+  size_t
+  skipAll();
+
+  const uint8_t*
+  pos() const
+  {
+    return m_pos;
+  }
+
+  const uint8_t*
+  end() const
+  {
+    return m_end;
+  }
+
+  /**
+   * @brief Mark the bytes before pos, which must be in [pos(), end()], as read
+   */
+  void
+  advance(const uint8_t* pos)
+  {
+    m_pos = pos;
+  }
+
+  static const size_t CHUNK_SIZE = 4096;
+
+private:
+  bool
+  refill(size_t size);
+
+private:
+  std::unique_ptr<boost::iostreams::filtering_streambuf<boost::iostreams::input>> m_in;
+  const uint8_t* m_pos;
+  const uint8_t* m_end;
+  uint8_t m_chunk[CHUNK_SIZE];
+};
 
 struct MissingDataInfo
 {
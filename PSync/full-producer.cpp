@@ -23,6 +23,7 @@
 #include <ndn-cxx/util/segment-fetcher.hpp>
 #include <ndn-cxx/security/validator-null.hpp>
 
+#include <algorithm>
 #include <cstring>
 #include <limits>
 #include <functional>
@@ -31,6 +32,13 @@ namespace psync {
 
 NDN_LOG_INIT(psync.FullProducer);
 
+// A folded IBF still has room for at least this many differences
+const size_t MIN_FOLDED_ENTRIES = 8;
+
+const ndn::name::Component RATELESS_COMPONENT("rateless");
+const ndn::name::Component SYMBOLS_COMPONENT("symbols");
+const ndn::name::Component ESTIMATOR_COMPONENT("estimator");
+
 FullProducer::FullProducer(const size_t expectedNumEntries,
                            ndn::Face& face,
                            const ndn::Name& syncPrefix,
@@ -38,10 +46,33 @@ FullProducer::FullProducer(const size_t expectedNumEntries,
                            const UpdateCallback& onUpdateCallBack,
                            ndn::time::milliseconds syncInterestLifetime,
                            ndn::time::milliseconds syncReplyFreshness)
-  : ProducerBase(expectedNumEntries, face, syncPrefix, userPrefix, syncReplyFreshness)
+  : FullProducer(expectedNumEntries, face, syncPrefix, userPrefix, onUpdateCallBack,
+                 syncInterestLifetime, syncReplyFreshness, Options())
+{
+}
+
+FullProducer::FullProducer(const size_t expectedNumEntries,
+                           ndn::Face& face,
+                           const ndn::Name& syncPrefix,
+                           const ndn::Name& userPrefix,
+                           const UpdateCallback& onUpdateCallBack,
+                           ndn::time::milliseconds syncInterestLifetime,
+                           ndn::time::milliseconds syncReplyFreshness,
+                           const Options& options)
+  : ProducerBase(expectedNumEntries, face, syncPrefix, userPrefix, syncReplyFreshness,
+                 HELLO_REPLY_FRESHNESS, options.ibltCompression, options.keyWidth,
+                 options.ibltParameters)
   , m_syncInterestLifetime(syncInterestLifetime)
   , m_onUpdate(onUpdateCallBack)
+  , m_foldIblt(options.foldIblt)
+  , m_useRatelessIblt(options.useRatelessIblt)
+  , m_useIbltDigest(options.useIbltDigest)
 {
+  if (options.useStrataEstimator) {
+    // Created before any key is inserted, so it holds the same keys as m_iblt
+    m_strataEstimator.emplace(options.keyWidth);
+  }
+
   int jitter = m_syncInterestLifetime.count() * .20;
   m_jitter = std::uniform_int_distribution<>(-jitter, jitter);
 
@@ -60,6 +91,9 @@ FullProducer::~FullProducer()
   if (m_fetcher) {
     m_fetcher->stop();
   }
+  for (auto& fetch : m_ratelessFetches) {
+    fetch.second.fetcher->stop();
+  }
 }
 
 void
@@ -70,11 +104,12 @@ FullProducer::publishName(const ndn::Name& prefix, ndn::optional<uint64_t> seq)
     return;
   }
 
-  uint64_t newSeq = seq.value_or(m_prefixes[prefix] + 1);
+  uint64_t newSeq = seq.value_or(m_prefixes[prefix].seq + 1);
 
   NDN_LOG_INFO("Publish: "<< prefix << "/" << newSeq);
 
   updateSeqNo(prefix, newSeq);
+  ++m_numUpdatesSinceSyncInterest;
 
   satisfyPendingInterests();
 }
@@ -89,11 +124,44 @@ FullProducer::sendSyncInterest()
     m_fetcher->stop();
   }
 
-  // Sync Interest format for full sync: /<sync-prefix>/<ourLatestIBF>
+  // Sync Interest format for full sync:
+  // /<sync-prefix>/<ourLatestIBF>[/estimator/<ourStrataEstimator>]
+  // or /<sync-prefix>/<ourLatestIBFDigestReference>
+  // or /<sync-prefix>/rateless/<ourLatestIBFDigest>
   ndn::Name syncInterestName = m_syncPrefix;
 
-  // Append our latest IBF
-  m_iblt.appendToName(syncInterestName);
+  if (m_useRatelessIblt) {
+    // Append only the digest of our latest IBF, the others fetch our coded symbols
+    syncInterestName.append(RATELESS_COMPONENT).appendNumber(m_iblt.getDigest());
+  }
+  else if (m_useIbltDigest && m_unknownDigest != m_iblt.getDigest()) {
+    // Append only the digest of our latest IBF, the others likely had the same IBF recently
+    syncInterestName.append(IBLT::makeDigestReference(m_iblt.getDigest()));
+  }
+  else {
+    // Append our latest IBF, folded as long as it keeps room for twice the differences we expect
+    size_t factor = 1;
+    if (m_foldIblt) {
+      size_t expectedDiff = std::max(2 * m_numUpdatesSinceSyncInterest, MIN_FOLDED_ENTRIES);
+      size_t bucketsPerHash = m_iblt.getNumCells() / m_iblt.getParameters().nHash;
+      while (bucketsPerHash % (factor * 2) == 0 &&
+             m_expectedNumEntries / (factor * 2) >= expectedDiff) {
+        factor *= 2;
+      }
+    }
+    if (factor == 1) {
+      m_iblt.appendToName(syncInterestName);
+    }
+    else {
+      m_iblt.fold(factor).appendToName(syncInterestName);
+    }
+
+    if (m_strataEstimator) {
+      syncInterestName.append(ESTIMATOR_COMPONENT);
+      m_strataEstimator->appendToName(syncInterestName);
+    }
+  }
+  m_numUpdatesSinceSyncInterest = 0;
 
   m_outstandingInterestName = syncInterestName;
 
@@ -112,7 +180,22 @@ FullProducer::sendSyncInterest()
   m_fetcher = SegmentFetcher::start(m_face, syncInterest,
                                     ndn::security::v2::getAcceptAllValidator(), options);
 
+  if (m_useIbltDigest) {
+    m_fetcher->afterSegmentValidated.connect([this, syncInterestName] (const ndn::Data& data) {
+      if (data.getContentType() == ndn::tlv::ContentType_Nack) {
+        // The other did not have our IBF, so send the whole of it next
+        m_unknownDigest = IBLT::extractDigest(syncInterestName.get(-1));
+      }
+    });
+  }
+
   m_fetcher->onComplete.connect([this, syncInterest] (const ndn::ConstBufferPtr& bufferPtr) {
+    const auto& ibltName = syncInterest.getName().get(-1);
+    if (IBLT::isDigestReference(ibltName) && m_unknownDigest == IBLT::extractDigest(ibltName)) {
+      NDN_LOG_TRACE("IBF digest unknown to the other, sending the whole IBF");
+      sendSyncInterest();
+      return;
+    }
     onSyncData(syncInterest, bufferPtr);
   });
 
@@ -132,60 +215,105 @@ FullProducer::onSyncInterest(const ndn::Name& prefixName, const ndn::Interest& i
   }
 
   ndn::Name nameWithoutSyncPrefix = interest.getName().getSubName(prefixName.size());
-  ndn::Name interestName;
 
-  if (nameWithoutSyncPrefix.size() == 1) {
-    // Get /<prefix>/IBF from /<prefix>/IBF
-    interestName = interest.getName();
-  }
-  else if (nameWithoutSyncPrefix.size() == 3) {
-    // Get /<prefix>/IBF from /<prefix>/IBF/<version>/<segment-no>
-    interestName = interest.getName().getPrefix(-2);
+  if (!nameWithoutSyncPrefix.empty() && nameWithoutSyncPrefix.get(0) == RATELESS_COMPONENT) {
+    onRatelessSyncInterest(prefixName, interest);
+    return;
   }
-  else {
+  if (!nameWithoutSyncPrefix.empty() && nameWithoutSyncPrefix.get(0) == SYMBOLS_COMPONENT) {
+    onSymbolsInterest(prefixName, interest);
     return;
   }
 
-  ndn::name::Component ibltName = interestName.get(interestName.size()-1);
+  // Get /<prefix>/IBF[/estimator/SE] from /<prefix>/IBF[/estimator/SE][/<version>/<segment-no>]
+  ndn::Name interestName = interest.getName();
+  if (nameWithoutSyncPrefix.size() >= 3 && nameWithoutSyncPrefix.get(-2).isVersion() &&
+      nameWithoutSyncPrefix.get(-1).isSegment()) {
+    interestName = interestName.getPrefix(-2);
+  }
+
+  // Anything else, e.g. an interest for a segment of sync data /<prefix>/IBF/<digest>/...
+  // that is no longer in our store, is not a sync interest
+  size_t nComponents = interestName.size() - prefixName.size();
+  bool hasStrataEstimator = nComponents == 3 &&
+                            interestName.get(prefixName.size() + 1) == ESTIMATOR_COMPONENT;
+  if (nComponents != 1 && !hasStrataEstimator) {
+    return;
+  }
+  ndn::name::Component ibltName = interestName.get(prefixName.size());
 
   NDN_LOG_DEBUG("Full Sync Interest Received, nonce: " << interest.getNonce() <<
                 ", hash: " << std::hash<ndn::Name>{}(interestName));
 
-  IBLT iblt(m_expectedNumEntries);
-  try {
-    iblt.initialize(ibltName);
-  }
-  catch (const std::exception& e) {
-    NDN_LOG_WARN(e.what());
+  // Same IBF as ours, as is usual in a group in sync: nothing to decode,
+  // keep the interest until we have an update.  The digest in a whole IBF is only what
+  // the other claims, so the IBF must also be encoded as ours is; the same keys folded
+  // or compressed differently are decoded below.
+  auto digest = IBLT::extractDigest(ibltName);
+  if (digest && *digest == m_iblt.getDigest() &&
+      (IBLT::isDigestReference(ibltName) || ibltName == m_iblt.getEncoded())) {
+    NDN_LOG_TRACE("Same IBF as ours, adding pending interest");
+    addPendingEntry(interest, interestName, IbltDifference(m_iblt, m_threshold));
     return;
   }
 
-  IBLT diff = m_iblt - iblt;
+  // We can only compare with the estimator of the other if we keep one ourselves,
+  // otherwise the IBF is decoded right away
+  if (hasStrataEstimator && m_strataEstimator) {
+    StrataEstimator strataEstimator(m_iblt.getKeyWidth());
+    try {
+      strataEstimator.initialize(interestName.get(-1));
+    }
+    catch (const std::exception& e) {
+      NDN_LOG_WARN(e.what());
+      return;
+    }
+
+    size_t estimate = m_strataEstimator->estimateDifference(strataEstimator);
+    if (estimate >= m_threshold) {
+      NDN_LOG_TRACE("Estimated difference " << estimate << " is above threshold, not decoding");
+      sendAllState(interest.getName());
+      return;
+    }
+  }
+
+  IBLT iblt(m_expectedNumEntries, CompressionScheme::DEFAULT, m_iblt.getKeyWidth(),
+            m_iblt.getParameters());
+  if (IBLT::isDigestReference(ibltName)) {
+    // The other refers to an IBF we had recently by its digest only
+    auto oldIblt = getIbltFromHistory(*digest);
+    if (!oldIblt) {
+      NDN_LOG_DEBUG("IBF digest not in our history, sending application Nack");
+      sendApplicationNack(interestName);
+      return;
+    }
+    iblt = std::move(*oldIblt);
+  }
+  else {
+    try {
+      iblt.initialize(ibltName);
+    }
+    catch (const std::exception& e) {
+      NDN_LOG_WARN(e.what());
+      return;
+    }
+  }
 
-  std::set<uint32_t> positive;
-  std::set<uint32_t> negative;
+  std::vector<uint64_t> positive;
+  std::vector<uint64_t> negative;
 
-  if (!diff.listEntries(positive, negative)) {
+  // Stop decoding once the differences reach threshold, all data is sent then anyway
+  DecodeResult result = decodeDifference(iblt, positive, negative);
+  if (result != DecodeResult::SUCCESS) {
     NDN_LOG_TRACE("Cannot decode differences, positive: " << positive.size()
                   << " negative: " << negative.size() << " m_threshold: "
                   << m_threshold);
 
     // Send all data if greater then threshold, else send positive below as usual
     // Or send if we can't get neither positive nor negative differences
-    if (positive.size() + negative.size() >= m_threshold ||
+    if (result == DecodeResult::EXCEEDED_BUDGET ||
         (positive.size() == 0 && negative.size() == 0)) {
-      State state;
-      for (const auto& content : m_prefixes) {
-        if (content.second != 0) {
-          state.addContent(ndn::Name(content.first).appendNumber(content.second));
-        }
-      }
-
-      if (!state.getContent().empty()) {
-        m_segmentPublisher.publish(interest.getName(), interest.getName(),
-                                   state.wireEncode(), m_syncReplyFreshness);
-      }
-
+      sendAllState(interest.getName());
       return;
     }
   }
@@ -194,8 +322,8 @@ FullProducer::onSyncInterest(const ndn::Name& prefixName, const ndn::Interest& i
   for (const auto& hash : positive) {
     const ndn::Name& prefix = m_hash2prefix[hash];
     // Don't sync up sequence number zero
-    if (m_prefixes[prefix] != 0 && !isFutureHash(prefix.toUri(), negative)) {
-      state.addContent(ndn::Name(prefix).appendNumber(m_prefixes[prefix]));
+    if (m_prefixes[prefix].seq != 0 && !isFutureHash(prefix.toUri(), negative)) {
+      state.addContent(ndn::Name(prefix).appendNumber(m_prefixes[prefix].seq));
     }
   }
 
@@ -205,24 +333,244 @@ FullProducer::onSyncInterest(const ndn::Name& prefixName, const ndn::Interest& i
     return;
   }
 
-  auto& entry = m_pendingEntries.emplace(interestName, PendingEntryInfoFull{iblt, {}}).first->second;
+  addPendingEntry(interest, interestName,
+                  makePendingDifference(iblt, result, positive, negative));
+}
+
+void
+FullProducer::addPendingEntry(const ndn::Interest& interest, const ndn::Name& interestName,
+                              IbltDifference&& difference)
+{
+  // The new difference is taken against our current IBF, so the updates
+  // made to it so far must only go to the existing entries
+  updatePendingDifferences(m_pendingEntries);
+  auto it = m_pendingEntries.find(interestName);
+  if (it == m_pendingEntries.end()) {
+    it = m_pendingEntries.emplace(interestName,
+                                  PendingEntryInfoFull{std::move(difference), {}}).first;
+  }
+  auto& entry = it->second;
   entry.expirationEvent = m_scheduler.schedule(interest.getInterestLifetime(),
-                          [this, interest] {
+                          [this, interest, interestName] {
                             NDN_LOG_TRACE("Erase Pending Interest " << interest.getNonce());
-                            m_pendingEntries.erase(interest.getName());
+                            m_pendingEntries.erase(interestName);
                           });
 }
 
+void
+FullProducer::onRatelessSyncInterest(const ndn::Name& prefixName, const ndn::Interest& interest)
+{
+  ndn::Name nameWithoutSyncPrefix = interest.getName().getSubName(prefixName.size());
+  if (nameWithoutSyncPrefix.size() != 2 && nameWithoutSyncPrefix.size() != 4) {
+    return;
+  }
+
+  // Get /<prefix>/rateless/<digest> from /<prefix>/rateless/<digest>[/<version>/<segment-no>]
+  ndn::Name interestName = interest.getName().getPrefix(prefixName.size() + 2);
+  if (!interestName.get(-1).isNumber()) {
+    return;
+  }
+  uint64_t digest = interestName.get(-1).toNumber();
+
+  NDN_LOG_DEBUG("Rateless Sync Interest Received, nonce: " << interest.getNonce() <<
+                ", digest: " << digest);
+
+  if (digest == m_iblt.getDigest()) {
+    // Same IBF as ours: nothing to send until we have an update
+    addPendingEntry(interest, interestName, IbltDifference(m_iblt, m_threshold));
+    return;
+  }
+
+  if (m_ratelessFetches.find(interestName) != m_ratelessFetches.end()) {
+    return;
+  }
+
+  ndn::Interest symbolsInterest(ndn::Name(prefixName).append(SYMBOLS_COMPONENT).appendNumber(digest));
+
+  using ndn::util::SegmentFetcher;
+  SegmentFetcher::Options options;
+  options.interestLifetime = m_syncInterestLifetime;
+  options.maxTimeout = m_syncInterestLifetime;
+  options.rttOptions.initialRto = m_syncInterestLifetime;
+
+  auto fetcher = SegmentFetcher::start(m_face, symbolsInterest,
+                                       ndn::security::v2::getAcceptAllValidator(), options);
+  // The decoder shares the set of the maintained encoder as it is now
+  m_ratelessFetches.emplace(interestName,
+                            RatelessFetch{fetcher, m_iblt.getDigest(),
+                                          RatelessDecoder(getRatelessEncoder()), {}, 0});
+
+  fetcher->afterSegmentValidated.connect([this, interest, interestName] (const ndn::Data& data) {
+    auto it = m_ratelessFetches.find(interestName);
+    if (it == m_ratelessFetches.end()) {
+      return;
+    }
+    RatelessFetch& fetch = it->second;
+
+    if (data.getContentType() == ndn::tlv::ContentType_Nack) {
+      // The other has updated its IBF since, and will send a sync interest for the new one
+      NDN_LOG_TRACE("Coded symbols no longer published, stopping fetch");
+      fetch.fetcher->stop();
+      m_ratelessFetches.erase(it);
+      return;
+    }
+
+    // Decode the segments in order, as soon as the ones before them are there
+    fetch.segments.emplace(data.getName().get(-1).toSegment(), data.getContent());
+    try {
+      for (auto segment = fetch.segments.find(fetch.nextSegment);
+           segment != fetch.segments.end() && !fetch.decoder.isDecoded();
+           segment = fetch.segments.find(fetch.nextSegment)) {
+        fetch.decoder.addEncodedBytes(segment->second.value(),
+                                      segment->second.value() + segment->second.value_size());
+        fetch.segments.erase(segment);
+        ++fetch.nextSegment;
+      }
+    }
+    catch (const RatelessDecoder::Error& e) {
+      NDN_LOG_WARN(e.what());
+      fetch.fetcher->stop();
+      m_ratelessFetches.erase(it);
+      return;
+    }
+
+    if (fetch.decoder.isDecoded()) {
+      NDN_LOG_TRACE("Decoded difference from " << fetch.decoder.getNumSymbols() << " coded symbols");
+      fetch.fetcher->stop();
+      RatelessFetch decoded = std::move(fetch);
+      m_ratelessFetches.erase(it);
+      onRatelessDecoded(interest, interestName, decoded);
+    }
+  });
+
+  fetcher->onComplete.connect([this, interestName] (const ndn::ConstBufferPtr&) {
+    auto it = m_ratelessFetches.find(interestName);
+    if (it == m_ratelessFetches.end()) {
+      return;
+    }
+    NDN_LOG_TRACE("Cannot decode differences from all coded symbols, sending all state");
+    m_ratelessFetches.erase(it);
+    sendAllState(interestName);
+  });
+
+  fetcher->onError.connect([this, interestName] (uint32_t errorCode, const std::string& msg) {
+    NDN_LOG_ERROR("Cannot fetch coded symbols, error: " << errorCode << " message: " << msg);
+    m_ratelessFetches.erase(interestName);
+  });
+}
+
+void
+FullProducer::onRatelessDecoded(const ndn::Interest& interest, const ndn::Name& interestName,
+                                const RatelessFetch& fetch)
+{
+  // We are the local side, the sender of the interest the remote one
+  const std::set<uint64_t>& positive = fetch.decoder.getLocalOnly();
+  std::vector<uint64_t> negative(fetch.decoder.getRemoteOnly().begin(),
+                                 fetch.decoder.getRemoteOnly().end());
+
+  State state;
+  for (const auto& hash : positive) {
+    // Our IBF may have changed while fetching
+    auto it = m_hash2prefix.find(hash);
+    if (it == m_hash2prefix.end()) {
+      continue;
+    }
+    const ndn::Name& prefix = it->second;
+    if (m_prefixes[prefix].seq != 0 && !isFutureHash(prefix.toUri(), negative)) {
+      state.addContent(ndn::Name(prefix).appendNumber(m_prefixes[prefix].seq));
+    }
+  }
+
+  if (!state.getContent().empty()) {
+    NDN_LOG_DEBUG("Sending sync content: " << state);
+    sendSyncData(interestName, state.wireEncode());
+    return;
+  }
+
+  if (fetch.digest == m_iblt.getDigest()) {
+    // Our IBF has not changed while fetching, so the decoded difference is still current
+    std::vector<uint64_t> positiveKeys(positive.begin(), positive.end());
+    addPendingEntry(interest, interestName,
+                    IbltDifference(m_iblt, m_iblt, positiveKeys, negative, m_threshold));
+    return;
+  }
+
+  // The IBF of the other side is the one we decoded against, plus and minus the difference
+  auto oldIblt = getIbltFromHistory(fetch.digest);
+  if (!oldIblt) {
+    NDN_LOG_TRACE("Our IBF changed too much while fetching, sending all state");
+    sendAllState(interestName);
+    return;
+  }
+  IBLT iblt = std::move(*oldIblt);
+  for (uint64_t hash : negative) {
+    iblt.insert(hash);
+  }
+  for (uint64_t hash : positive) {
+    iblt.erase(hash);
+  }
+  addPendingEntry(interest, interestName, IbltDifference(m_iblt, iblt, m_threshold));
+}
+
+void
+FullProducer::onSymbolsInterest(const ndn::Name& prefixName, const ndn::Interest& interest)
+{
+  ndn::Name nameWithoutSyncPrefix = interest.getName().getSubName(prefixName.size());
+  if (nameWithoutSyncPrefix.size() != 2 && nameWithoutSyncPrefix.size() != 4) {
+    return;
+  }
+
+  // Get /<prefix>/symbols/<digest> from /<prefix>/symbols/<digest>[/<version>/<segment-no>]
+  ndn::Name symbolsName = interest.getName().getPrefix(prefixName.size() + 2);
+  if (!symbolsName.get(-1).isNumber()) {
+    return;
+  }
+  if (symbolsName.get(-1).toNumber() != m_iblt.getDigest()) {
+    // Let the other stop fetching, we send a sync interest for our current IBF anyway
+    NDN_LOG_TRACE("Coded symbols requested for an outdated IBF: " << symbolsName);
+    sendApplicationNack(symbolsName);
+    return;
+  }
+
+  m_segmentPublisher.publish(interest.getName(), symbolsName,
+                             getRatelessEncoder().wireEncode(m_iblt.getNumCells()),
+                             m_syncReplyFreshness);
+}
+
+const RatelessEncoder&
+FullProducer::getRatelessEncoder()
+{
+  if (!m_ratelessEncoder) {
+    m_ratelessEncoder.emplace(m_iblt.getKeyWidth(), m_iblt.getNumCells());
+    for (const auto& entry : m_hash2prefix) {
+      m_ratelessEncoder->insert(entry.first);
+    }
+  }
+  return *m_ratelessEncoder;
+}
+
+void
+FullProducer::sendAllState(const ndn::Name& name)
+{
+  State state;
+  for (const auto& content : m_prefixes) {
+    if (content.second.seq != 0) {
+      state.addContent(ndn::Name(content.first).appendNumber(content.second.seq));
+    }
+  }
+
+  if (!state.getContent().empty()) {
+    m_segmentPublisher.publish(name, name, state.wireEncode(), m_syncReplyFreshness);
+  }
+}
+
 void
 FullProducer::sendSyncData(const ndn::Name& name, const ndn::Block& block)
 {
   NDN_LOG_DEBUG("Checking if data will satisfy our own pending interest");
 
-  ndn::Name nameWithIblt;
-  m_iblt.appendToName(nameWithIblt);
-
   // Append hash of our IBF so that data name maybe different for each node answering
-  ndn::Name dataName(ndn::Name(name).appendNumber(std::hash<ndn::Name>{}(nameWithIblt)));
+  ndn::Name dataName(ndn::Name(name).appendNumber(m_iblt.getDigest()));
 
   // checking if our own interest got satisfied
   if (m_outstandingInterestName == name) {
@@ -255,6 +603,7 @@ FullProducer::onSyncData(const ndn::Interest& interest, const ndn::ConstBufferPt
 
   State state{ndn::Block{bufferPtr}};
   std::vector<MissingDataInfo> updates;
+  std::vector<std::pair<ndn::Name, uint64_t>> seqUpdates;
 
   NDN_LOG_DEBUG("Sync Data Received: " << state);
 
@@ -262,9 +611,9 @@ FullProducer::onSyncData(const ndn::Interest& interest, const ndn::ConstBufferPt
     const ndn::Name& prefix = content.getPrefix(-1);
     uint64_t seq = content.get(content.size() - 1).toNumber();
 
-    if (m_prefixes.find(prefix) == m_prefixes.end() || m_prefixes[prefix] < seq) {
-      updates.push_back(MissingDataInfo{prefix, m_prefixes[prefix] + 1, seq});
-      updateSeqNo(prefix, seq);
+    if (m_prefixes.find(prefix) == m_prefixes.end() || m_prefixes[prefix].seq < seq) {
+      updates.push_back(MissingDataInfo{prefix, m_prefixes[prefix].seq + 1, seq});
+      seqUpdates.emplace_back(prefix, seq);
       // We should not call satisfyPendingSyncInterests here because we just
       // got data and deleted pending interest by calling deletePendingFullSyncInterests
       // But we might have interests not matching to this interest that might not have deleted
@@ -272,6 +621,12 @@ FullProducer::onSyncData(const ndn::Interest& interest, const ndn::ConstBufferPt
     }
   }
 
+  // Sync data lists each prefix at most once and can carry many of them,
+  // so apply all the updates to the IBF in one batch
+  updateSeqNo(seqUpdates);
+  m_numUpdatesSinceSyncInterest += seqUpdates.size();
+  updatePendingDifferences(m_pendingEntries);
+
   // We just got the data, so send a new sync interest
   if (!updates.empty()) {
     m_onUpdate(updates);
@@ -289,15 +644,17 @@ FullProducer::satisfyPendingInterests()
 {
   NDN_LOG_DEBUG("Satisfying full sync interest: " << m_pendingEntries.size());
 
+  updatePendingDifferences(m_pendingEntries);
+
   for (auto it = m_pendingEntries.begin(); it != m_pendingEntries.end();) {
-    const PendingEntryInfoFull& entry = it->second;
-    IBLT diff = m_iblt - entry.iblt;
-    std::set<uint32_t> positive;
-    std::set<uint32_t> negative;
+    const IbltDifference& difference = it->second.difference;
+    const std::set<uint64_t>& positive = difference.getPositive();
+    const std::set<uint64_t>& negative = difference.getNegative();
 
-    if (!diff.listEntries(positive, negative)) {
+    DecodeResult result = difference.getResult();
+    if (result != DecodeResult::SUCCESS) {
       NDN_LOG_TRACE("Decode failed for pending interest");
-      if (positive.size() + negative.size() >= m_threshold ||
+      if (result == DecodeResult::EXCEEDED_BUDGET ||
           (positive.size() == 0 && negative.size() == 0)) {
         NDN_LOG_TRACE("pos + neg > threshold or no diff can be found, erase pending interest");
         it = m_pendingEntries.erase(it);
@@ -309,8 +666,8 @@ FullProducer::satisfyPendingInterests()
     for (const auto& hash : positive) {
       ndn::Name prefix = m_hash2prefix[hash];
 
-      if (m_prefixes[prefix] != 0) {
-        state.addContent(ndn::Name(prefix).appendNumber(m_prefixes[prefix]));
+      if (m_prefixes[prefix].seq != 0) {
+        state.addContent(ndn::Name(prefix).appendNumber(m_prefixes[prefix].seq));
       }
     }
 
@@ -326,10 +683,9 @@ FullProducer::satisfyPendingInterests()
 }
 
 bool
-FullProducer::isFutureHash(const ndn::Name& prefix, const std::set<uint32_t>& negative)
+FullProducer::isFutureHash(const ndn::Name& prefix, const std::vector<uint64_t>& negative)
 {
-  uint32_t nextHash = murmurHash3(N_HASHCHECK,
-                                  ndn::Name(prefix).appendNumber(m_prefixes[prefix] + 1).toUri());
+  uint64_t nextHash = hashPrefixWithSeq(ndn::Name(prefix).appendNumber(m_prefixes[prefix].seq + 1));
   for (const auto& nHash : negative) {
     if (nHash == nextHash) {
       return true;
@@ -21,6 +21,7 @@
 #define PSYNC_FULL_PRODUCER_HPP
 
 #include "PSync/producer-base.hpp"
+#include "PSync/detail/rateless-iblt.hpp"
 #include "PSync/detail/state.hpp"
 
 #include <map>
@@ -40,10 +41,23 @@ namespace psync {
 // when partial producer is destructed
 struct PendingEntryInfoFull
 {
-  IBLT iblt;
+  // Our IBF minus the IBF of the sync interest, kept up to date with ours
+  IbltDifference difference;
   ndn::scheduler::ScopedEventId expirationEvent;
 };
 
+// Fetch of the coded symbols of the sender of a rateless sync interest
+struct RatelessFetch
+{
+  std::shared_ptr<ndn::util::SegmentFetcher> fetcher;
+  // Digest of our IBF when the fetch started, the set the decoder subtracts
+  uint64_t digest;
+  RatelessDecoder decoder;
+  // Segments received ahead of the next one to decode
+  std::map<uint64_t, ndn::Block> segments;
+  uint64_t nextSegment;
+};
+
 typedef std::function<void(const std::vector<MissingDataInfo>&)> UpdateCallback;
 
 const ndn::time::milliseconds SYNC_INTEREST_LIFTIME = 1_s;
@@ -60,12 +74,43 @@ const ndn::time::milliseconds SYNC_INTEREST_LIFTIME = 1_s;
 class FullProducer : public ProducerBase
 {
 public:
+  /**
+   * @brief How our IBF is kept and sent, the defaults are those of earlier versions
+   */
+  struct Options
+  {
+    /// compression scheme for our IBF in sync interest and data names
+    CompressionScheme ibltCompression = CompressionScheme::DEFAULT;
+    /// whether to append a strata estimator to our sync interests so that others can tell
+    /// without decoding that our IBF differs too much from theirs; only then is our own
+    /// estimator kept up to date and compared with received ones
+    bool useStrataEstimator = false;
+    /// whether to send a folded, smaller IBF in sync interests when we expect few
+    /// differences (see IBLT::fold), i.e. when our IBF saw few updates since the last
+    /// sync interest
+    bool foldIblt = false;
+    /// width of the prefix/seq hashes in the IBF, same for the whole sync group
+    KeyWidth keyWidth = KeyWidth::DEFAULT;
+    /// whether to send only the digest of our IBF in sync interests and let the others
+    /// fetch the coded symbols of our set (see RatelessEncoder) until they decode the
+    /// difference, instead of sending a fixed-size IBF
+    bool useRatelessIblt = false;
+    /// geometry of the IBF; the number of hashes, the check seed and the hash family
+    /// must be the same for the whole sync group
+    IbltParameters ibltParameters;
+    /// whether to send only the digest of our IBF in sync interests
+    /// (see IBLT::makeDigestReference), which the others can use if our IBF is one they
+    /// had recently, instead of the whole IBF; the whole IBF is sent again after a Nack
+    bool useIbltDigest = false;
+  };
+
   /**
    * @brief constructor
    *
    * Registers syncPrefix in NFD and sends a sync interest
    *
-   * @param expectedNumEntries expected entries in IBF
+   * @param expectedNumEntries expected entries in IBF, used as given
+   *        unless auto-sizing is turned on (see ProducerBase::setAutoSizing)
    * @param face application's face
    * @param syncPrefix The prefix of the sync group
    * @param userPrefix The prefix of the first user in the group
@@ -81,6 +126,22 @@ public:
                ndn::time::milliseconds syncInterestLifetime = SYNC_INTEREST_LIFTIME,
                ndn::time::milliseconds syncReplyFreshness = SYNC_REPLY_FRESHNESS);
 
+  /**
+   * @brief constructor
+   *
+   * Same as the one above, with options for our IBF
+   *
+   * @param options how our IBF is kept and sent, see Options
+   */
+  FullProducer(size_t expectedNumEntries,
+               ndn::Face& face,
+               const ndn::Name& syncPrefix,
+               const ndn::Name& userPrefix,
+               const UpdateCallback& onUpdateCallBack,
+               ndn::time::milliseconds syncInterestLifetime,
+               ndn::time::milliseconds syncReplyFreshness,
+               const Options& options);
+
   ~FullProducer();
 
   /**
@@ -101,7 +162,9 @@ PSYNC_PUBLIC_WITH_TESTS_ELSE_PRIVATE:
   /**
    * @brief Send sync interest for full synchronization
    *
-   * Forms the interest name: /<sync-prefix>/<own-IBF>
+   * Forms the interest name: /<sync-prefix>/<own-IBF>[/estimator/<own-strata-estimator>]
+   * where own-IBF may be folded to a smaller size if we expect few differences,
+   * or /<sync-prefix>/rateless/<own-IBF-digest> in rateless mode
    * Cancels any pending sync interest we sent earlier on the face
    * Sends the sync interest
    */
@@ -111,6 +174,10 @@ PSYNC_PUBLIC_WITH_TESTS_ELSE_PRIVATE:
   /**
    * @brief Process sync interest from other parties
    *
+   * If the interest carries a strata estimator, we keep one too (useStrataEstimator)
+   * and it estimates the difference to be above threshold, send all our data without
+   * decoding the IBF.
+   *
    * Get differences b/w our IBF and IBF in the sync interest.
    * If we cannot get the differences successfully then send an application nack.
    *
@@ -119,6 +186,9 @@ PSYNC_PUBLIC_WITH_TESTS_ELSE_PRIVATE:
    * Otherwise add the sync interest into a map with interest name as key and PendingEntryInfoFull
    * as value.
    *
+   * Rateless sync interests and interests for our coded symbols are passed on to
+   * onRatelessSyncInterest and onSymbolsInterest.
+   *
    * @param prefixName prefix for sync group which we registered
    * @param interest the interest we got
    */
@@ -126,6 +196,68 @@ PSYNC_PUBLIC_WITH_TESTS_ELSE_PRIVATE:
   onSyncInterest(const ndn::Name& prefixName, const ndn::Interest& interest);
 
 private:
+  /**
+   * @brief Process rateless sync interest /<sync-prefix>/rateless/<IBF-digest>
+   *
+   * If the digest is not the one of our IBF, fetch the coded symbols of the other side
+   * from /<sync-prefix>/symbols/<IBF-digest> and decode them as they come.  Once the
+   * difference is decoded, stop fetching and go on as for an IBF (see onRatelessDecoded).
+   * If all the coded symbols do not suffice, send all our data.
+   */
+  void
+  onRatelessSyncInterest(const ndn::Name& prefixName, const ndn::Interest& interest);
+
+  /**
+   * @brief Reply to a rateless sync interest with the data the other side is missing,
+   *        or keep it pending if there is none
+   */
+  void
+  onRatelessDecoded(const ndn::Interest& interest, const ndn::Name& interestName,
+                    const RatelessFetch& fetch);
+
+  /**
+   * @brief Publish the coded symbols of our set if the digest in the interest
+   *        /<sync-prefix>/symbols/<IBF-digest> is still the one of our IBF,
+   *        or else an application Nack that stops the fetch of the other side
+   *
+   * As many coded symbols as our IBF has cells are published: beyond that the
+   * difference is above threshold and the other side sends all its data.
+   */
+  void
+  onSymbolsInterest(const ndn::Name& prefixName, const ndn::Interest& interest);
+
+  /**
+   * @brief Get the rateless encoder of our set
+   *
+   * It is created from our set the first time it is needed and then kept up to date
+   * as keys are inserted and erased (see ProducerBase::m_ratelessEncoder), with as many
+   * coded symbols cached as we publish.
+   */
+  const RatelessEncoder&
+  getRatelessEncoder();
+
+  /**
+   * @brief Keep sync interest pending until we have data the other side is missing
+   *
+   * @param interest the sync interest
+   * @param interestName name of the sync interest without version and segment
+   * @param difference difference between our current IBF and the IBF of the other side,
+   *        kept unless the interest is already pending
+   */
+  void
+  addPendingEntry(const ndn::Interest& interest, const ndn::Name& interestName,
+                  IbltDifference&& difference);
+
+  /**
+   * @brief Send all our prefixes and their sequence numbers
+   *
+   * Used when the difference to the other side is too large to be decoded
+   *
+   * @param name name of the sync interest, used as data name
+   */
+  void
+  sendAllState(const ndn::Name& name);
+
   /**
    * @brief Send sync data
    *
@@ -180,12 +312,20 @@ private:
    * gets to us before the data
    */
   bool
-  isFutureHash(const ndn::Name& prefix, const std::set<uint32_t>& negative);
+  isFutureHash(const ndn::Name& prefix, const std::vector<uint64_t>& negative);
 
 private:
   std::map<ndn::Name, PendingEntryInfoFull> m_pendingEntries;
   ndn::time::milliseconds m_syncInterestLifetime;
   UpdateCallback m_onUpdate;
+  bool m_foldIblt;
+  bool m_useRatelessIblt;
+  bool m_useIbltDigest;
+  // Digest of our IBF that another did not know when we sent only the digest
+  ndn::optional<uint64_t> m_unknownDigest;
+  std::map<ndn::Name, RatelessFetch> m_ratelessFetches;
+  // Updates to our IBF since the last sync interest, i.e. differences the others may not know
+  size_t m_numUpdatesSinceSyncInterest = 0;
   ndn::scheduler::ScopedEventId m_scheduledSyncInterestId;
   std::uniform_int_distribution<> m_jitter;
   ndn::Name m_outstandingInterestName;
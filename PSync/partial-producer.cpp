@@ -34,9 +34,12 @@ PartialProducer::PartialProducer(size_t expectedNumEntries,
                                  const ndn::Name& syncPrefix,
                                  const ndn::Name& userPrefix,
                                  ndn::time::milliseconds syncReplyFreshness,
-                                 ndn::time::milliseconds helloReplyFreshness)
- : ProducerBase(expectedNumEntries, face, syncPrefix,
-                userPrefix, syncReplyFreshness, helloReplyFreshness)
+                                 ndn::time::milliseconds helloReplyFreshness,
+                                 CompressionScheme ibltCompression,
+                                 KeyWidth keyWidth,
+                                 const IbltParameters& ibltParameters)
+ : ProducerBase(expectedNumEntries, face, syncPrefix, userPrefix, syncReplyFreshness,
+                helloReplyFreshness, ibltCompression, keyWidth, ibltParameters)
 {
   m_registeredPrefix = m_face.registerPrefix(m_syncPrefix,
     [this] (const ndn::Name& syncPrefix) {
@@ -55,7 +58,7 @@ PartialProducer::publishName(const ndn::Name& prefix, ndn::optional<uint64_t> se
     return;
   }
 
-  uint64_t newSeq = seq.value_or(m_prefixes[prefix] + 1);
+  uint64_t newSeq = seq.value_or(m_prefixes[prefix].seq + 1);
 
   NDN_LOG_INFO("Publish: " << prefix << "/" << newSeq);
 
@@ -83,7 +86,7 @@ PartialProducer::onHelloInterest(const ndn::Name& prefix, const ndn::Interest& i
   State state;
 
   for (const auto& prefix : m_prefixes) {
-    state.addContent(ndn::Name(prefix.first).appendNumber(prefix.second));
+    state.addContent(ndn::Name(prefix.first).appendNumber(prefix.second.seq));
   }
   NDN_LOG_DEBUG("sending content p: " << state);
 
@@ -136,32 +139,60 @@ PartialProducer::onSyncInterest(const ndn::Name& prefix, const ndn::Interest& in
   }
 
   BloomFilter bf;
-  IBLT iblt(m_expectedNumEntries);
-
   try {
     bf = BloomFilter(projectedCount, falsePositiveProb, bfName);
-    iblt.initialize(ibltName);
   }
   catch (const std::exception& e) {
     NDN_LOG_WARN(e.what());
     return;
   }
 
-  // get the difference
-  IBLT diff = m_iblt - iblt;
+  // The consumer has our current IBF, by reference or as we sent it: nothing to decode,
+  // keep the interest until we have an update
+  auto digest = IBLT::extractDigest(ibltName);
+  if (digest && *digest == m_iblt.getDigest() &&
+      (IBLT::isDigestReference(ibltName) || ibltName == m_iblt.getEncoded())) {
+    NDN_LOG_TRACE("Same IBF as ours, adding pending interest");
+    addPendingEntry(interest, interestName, bf, IbltDifference(m_iblt, m_threshold));
+    return;
+  }
+
+  IBLT iblt(m_expectedNumEntries, CompressionScheme::DEFAULT, m_iblt.getKeyWidth(),
+            m_iblt.getParameters());
+  if (IBLT::isDigestReference(ibltName)) {
+    // The consumer refers to an IBF we sent it by its digest only
+    auto oldIblt = getIbltFromHistory(*digest);
+    if (!oldIblt) {
+      NDN_LOG_DEBUG("IBF digest not in our history, sending application Nack");
+      sendApplicationNack(interestName);
+      return;
+    }
+    iblt = std::move(*oldIblt);
+  }
+  else {
+    try {
+      iblt.initialize(ibltName);
+    }
+    catch (const std::exception& e) {
+      NDN_LOG_WARN(e.what());
+      return;
+    }
+  }
 
   // non-empty positive means we have some elements that the others don't
-  std::set<uint32_t> positive;
-  std::set<uint32_t> negative;
+  std::vector<uint64_t> positive;
+  std::vector<uint64_t> negative;
 
   NDN_LOG_TRACE("Number elements in IBF: " << m_prefixes.size());
 
-  bool peel = diff.listEntries(positive, negative);
+  // Only a complete decode lets us tell what the consumer is missing, so give up once
+  // the differences reach threshold: the consumer is better off saying hello again
+  DecodeResult result = decodeDifference(iblt, positive, negative);
 
-  NDN_LOG_TRACE("Result of listEntries on the difference: " << peel);
+  NDN_LOG_TRACE("Result of decoding the difference: " << (result == DecodeResult::SUCCESS));
 
-  if (!peel) {
-    NDN_LOG_DEBUG("Can't decode the difference, sending application Nack");
+  if (result != DecodeResult::SUCCESS) {
+    NDN_LOG_DEBUG("Can't decode the difference below threshold, sending application Nack");
     sendApplicationNack(interestName);
     return;
   }
@@ -174,8 +205,8 @@ PartialProducer::onSyncInterest(const ndn::Name& prefix, const ndn::Interest& in
     ndn::Name prefix = m_hash2prefix[hash];
     if (bf.contains(prefix.toUri())) {
       // generate data
-      state.addContent(ndn::Name(prefix).appendNumber(m_prefixes[prefix]));
-      NDN_LOG_DEBUG("Content: " << prefix << " " << std::to_string(m_prefixes[prefix]));
+      state.addContent(ndn::Name(prefix).appendNumber(m_prefixes[prefix].seq));
+      NDN_LOG_DEBUG("Content: " << prefix << " " << std::to_string(m_prefixes[prefix].seq));
     }
   }
 
@@ -192,7 +223,24 @@ PartialProducer::onSyncInterest(const ndn::Name& prefix, const ndn::Interest& in
     return;
   }
 
-  auto& entry = m_pendingEntries.emplace(interestName, PendingEntryInfo{bf, iblt, {}}).first->second;
+  // Only a complete decode gets here, so nothing needs to be decoded again
+  addPendingEntry(interest, interestName, bf,
+                  makePendingDifference(iblt, result, positive, negative));
+}
+
+void
+PartialProducer::addPendingEntry(const ndn::Interest& interest, const ndn::Name& interestName,
+                                 const BloomFilter& bf, IbltDifference&& difference)
+{
+  // The new difference is taken against our current IBF, so the updates
+  // made to it so far must only go to the existing entries
+  updatePendingDifferences(m_pendingEntries);
+  auto it = m_pendingEntries.find(interestName);
+  if (it == m_pendingEntries.end()) {
+    it = m_pendingEntries.emplace(interestName,
+                                  PendingEntryInfo{bf, std::move(difference), {}}).first;
+  }
+  auto& entry = it->second;
   entry.expirationEvent = m_scheduler.schedule(interest.getInterestLifetime(),
                           [this, interest] {
                             NDN_LOG_TRACE("Erase Pending Interest " << interest.getNonce());
@@ -204,21 +252,23 @@ void
 PartialProducer::satisfyPendingSyncInterests(const ndn::Name& prefix) {
   NDN_LOG_TRACE("size of pending interest: " << m_pendingEntries.size());
 
+  updatePendingDifferences(m_pendingEntries);
+
   for (auto it = m_pendingEntries.begin(); it != m_pendingEntries.end();) {
     const PendingEntryInfo& entry = it->second;
+    const std::set<uint64_t>& positive = entry.difference.getPositive();
+    const std::set<uint64_t>& negative = entry.difference.getNegative();
 
-    IBLT diff = m_iblt - entry.iblt;
-    std::set<uint32_t> positive;
-    std::set<uint32_t> negative;
-
-    bool peel = diff.listEntries(positive, negative);
+    // Only the new prefix is sent, so the rest of the differences
+    // need not be decoded once they reach threshold
+    DecodeResult result = entry.difference.getResult();
 
-    NDN_LOG_TRACE("Result of listEntries on the difference: " << peel);
+    NDN_LOG_TRACE("Result of decoding the difference: " << (result == DecodeResult::SUCCESS));
 
     NDN_LOG_TRACE("Number elements in IBF: " << m_prefixes.size());
     NDN_LOG_TRACE("m_threshold: " << m_threshold << " Total: " << positive.size() + negative.size());
 
-    if (!peel) {
+    if (result == DecodeResult::FAILED) {
       NDN_LOG_TRACE("Decoding of differences with stored IBF unsuccessful, deleting pending interest");
       m_pendingEntries.erase(it++);
       continue;
@@ -227,8 +277,8 @@ PartialProducer::satisfyPendingSyncInterests(const ndn::Name& prefix) {
     State state;
     if (entry.bf.contains(prefix.toUri()) || positive.size() + negative.size() >= m_threshold) {
       if (entry.bf.contains(prefix.toUri())) {
-        state.addContent(ndn::Name(prefix).appendNumber(m_prefixes[prefix]));
-        NDN_LOG_DEBUG("sending sync content " << prefix << " " << std::to_string(m_prefixes[prefix]));
+        state.addContent(ndn::Name(prefix).appendNumber(m_prefixes[prefix].seq));
+        NDN_LOG_DEBUG("sending sync content " << prefix << " " << std::to_string(m_prefixes[prefix].seq));
       }
       else {
         NDN_LOG_DEBUG("Sending with empty content to send latest IBF to consumer");
@@ -35,7 +35,8 @@ namespace psync {
 struct PendingEntryInfo
 {
   BloomFilter bf;
-  IBLT iblt;
+  // Our IBF minus the IBF of the sync interest, kept up to date with ours
+  IbltDifference difference;
   ndn::scheduler::ScopedEventId expirationEvent;
 };
 
@@ -56,19 +57,26 @@ public:
    * Registers syncPrefix in NFD and sets internal filters for
    * "sync" and "hello" under syncPrefix
    *
-   * @param expectedNumEntries expected entries in IBF
+   * @param expectedNumEntries expected entries in IBF, used as given
+   *        unless auto-sizing is turned on (see ProducerBase::setAutoSizing)
    * @param face application's face
    * @param syncPrefix The prefix of the sync group
    * @param userPrefix The prefix of the first user in the group
    * @param syncReplyFreshness freshness of sync data
    * @param helloReplyFreshness freshness of hello data
+   * @param ibltCompression compression scheme for our IBF in hello and sync data names
+   * @param keyWidth width of the prefix/seq hashes in the IBF
+   * @param ibltParameters geometry of the IBF, see IbltParameters
    */
   PartialProducer(size_t expectedNumEntries,
                   ndn::Face& face,
                   const ndn::Name& syncPrefix,
                   const ndn::Name& userPrefix,
                   ndn::time::milliseconds helloReplyFreshness = HELLO_REPLY_FRESHNESS,
-                  ndn::time::milliseconds syncReplyFreshness = SYNC_REPLY_FRESHNESS);
+                  ndn::time::milliseconds syncReplyFreshness = SYNC_REPLY_FRESHNESS,
+                  CompressionScheme ibltCompression = CompressionScheme::DEFAULT,
+                  KeyWidth keyWidth = KeyWidth::DEFAULT,
+                  const IbltParameters& ibltParameters = IbltParameters());
 
   /**
    * @brief Publish name to let subscribed consumers know
@@ -117,6 +125,19 @@ PSYNC_PUBLIC_WITH_TESTS_ELSE_PRIVATE:
   void
   onSyncInterest(const ndn::Name& prefix, const ndn::Interest& interest);
 
+  /**
+   * @brief Keep sync interest pending until we have an update the consumer subscribed to
+   *
+   * @param interest the sync interest
+   * @param interestName name of the sync interest without version and segment
+   * @param bf the subscriptions of the consumer
+   * @param difference difference between our current IBF and the IBF of the consumer,
+   *        kept unless the interest is already pending
+   */
+  void
+  addPendingEntry(const ndn::Interest& interest, const ndn::Name& interestName,
+                  const BloomFilter& bf, IbltDifference&& difference);
+
 PSYNC_PUBLIC_WITH_TESTS_ELSE_PRIVATE:
   std::map<ndn::Name, PendingEntryInfo> m_pendingEntries;
   ndn::ScopedRegisteredPrefixHandle m_registeredPrefix;
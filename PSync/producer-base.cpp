@@ -22,21 +22,38 @@
 #include <ndn-cxx/util/logger.hpp>
 #include <boost/algorithm/string.hpp>
 
+#include <algorithm>
 #include <cstring>
 #include <limits>
 #include <functional>
+#include <unordered_map>
 
 namespace psync {
 
 NDN_LOG_INIT(psync.ProducerBase);
 
+// Number of decoded differences kept by ProducerBase::decodeDifference
+const size_t DECODE_CACHE_SIZE = 16;
+
+// Smallest table picked by ProducerBase::pickExpectedNumEntries: below it, differences of
+// threshold size fail to decode more than 1% of the time (see tools/iblt-calibrate)
+const size_t MIN_PICKED_NUM_ENTRIES = 64;
+
+// How many times larger or smaller than the constructed IBF auto-sizing makes it:
+// two members that pick the opposite extremes are MAX_RECEIVED_GROWTH apart
+const size_t MAX_AUTO_SIZING_FACTOR = 4;
+
 ProducerBase::ProducerBase(size_t expectedNumEntries,
                            ndn::Face& face,
                            const ndn::Name& syncPrefix,
                            const ndn::Name& userPrefix,
                            ndn::time::milliseconds syncReplyFreshness,
-                           ndn::time::milliseconds helloReplyFreshness)
-  : m_iblt(expectedNumEntries)
+                           ndn::time::milliseconds helloReplyFreshness,
+                           CompressionScheme ibltCompression,
+                           KeyWidth keyWidth,
+                           const IbltParameters& ibltParameters)
+  : m_constructedNumEntries(expectedNumEntries)
+  , m_iblt(expectedNumEntries, ibltCompression, keyWidth, ibltParameters)
   , m_expectedNumEntries(expectedNumEntries)
   , m_threshold(expectedNumEntries/2)
   , m_face(face)
@@ -48,6 +65,7 @@ ProducerBase::ProducerBase(size_t expectedNumEntries,
   , m_segmentPublisher(m_face, m_keyChain)
   , m_rng(ndn::random::getRandomNumberEngine())
 {
+  m_nConstructedCells = m_iblt.getNumCells();
   addUserNode(userPrefix);
 }
 
@@ -55,7 +73,7 @@ bool
 ProducerBase::addUserNode(const ndn::Name& prefix)
 {
   if (m_prefixes.find(prefix) == m_prefixes.end()) {
-    m_prefixes[prefix] = 0;
+    m_prefixes[prefix] = PrefixInfo{};
     return true;
   }
   else {
@@ -68,38 +86,367 @@ ProducerBase::removeUserNode(const ndn::Name& prefix)
 {
   auto it = m_prefixes.find(prefix);
   if (it != m_prefixes.end()) {
-    uint64_t seqNo = it->second;
+    uint64_t seqNo = it->second.seq;
+    ndn::optional<IBLT::KeyCells> keyCells = it->second.keyCells;
     m_prefixes.erase(it);
 
     ndn::Name prefixWithSeq = ndn::Name(prefix).appendNumber(seqNo);
     auto hashIt = m_prefix2hash.find(prefixWithSeq);
     if (hashIt != m_prefix2hash.end()) {
-      uint32_t hash = hashIt->second;
+      uint64_t hash = hashIt->second;
       m_prefix2hash.erase(hashIt);
       m_hash2prefix.erase(hash);
-      m_iblt.erase(hash);
+      recordIbltUpdate(m_iblt.getDigest(), {hash}, {});
+      eraseFromIblt(hash, keyCells);
     }
   }
 }
 
 void
 ProducerBase::updateSeqNo(const ndn::Name& prefix, uint64_t seq)
+{
+  ndn::optional<uint64_t> oldHash;
+  uint64_t newHash;
+  ndn::optional<IBLT::KeyCells>* keyCells;
+  if (!updatePrefixMaps(prefix, seq, oldHash, newHash, keyCells)) {
+    return;
+  }
+
+  std::vector<uint64_t> erased;
+  if (oldHash) {
+    erased.push_back(*oldHash);
+  }
+  recordIbltUpdate(m_iblt.getDigest(), erased, {newHash});
+
+  if (oldHash) {
+    eraseFromIblt(*oldHash, *keyCells);
+  }
+  insertIntoIblt(newHash, *keyCells);
+}
+
+void
+ProducerBase::updateSeqNo(const std::vector<std::pair<ndn::Name, uint64_t>>& updates)
+{
+  struct PrefixUpdate
+  {
+    ndn::optional<IBLT::KeyCells>* keyCells;
+    ndn::optional<uint64_t> oldHash;
+    uint64_t newHash;
+  };
+
+  // One update per prefix: a prefix that appears more than once erases the hash it had
+  // before the batch and inserts the one it has after it, the hashes in between never
+  // reach the IBF
+  std::vector<PrefixUpdate> prefixUpdates;
+  std::unordered_map<const ndn::optional<IBLT::KeyCells>*, size_t> prefixUpdateIndex;
+  for (const auto& update : updates) {
+    ndn::optional<uint64_t> oldHash;
+    uint64_t newHash;
+    ndn::optional<IBLT::KeyCells>* keyCells;
+    if (updatePrefixMaps(update.first, update.second, oldHash, newHash, keyCells)) {
+      auto it = prefixUpdateIndex.emplace(keyCells, prefixUpdates.size());
+      if (it.second) {
+        prefixUpdates.push_back({keyCells, oldHash, newHash});
+      }
+      else {
+        prefixUpdates[it.first->second].newHash = newHash;
+      }
+    }
+  }
+
+  std::vector<uint64_t> erased;
+  std::vector<uint64_t> inserted;
+  for (const auto& prefixUpdate : prefixUpdates) {
+    if (prefixUpdate.oldHash) {
+      erased.push_back(*prefixUpdate.oldHash);
+    }
+    inserted.push_back(prefixUpdate.newHash);
+  }
+  recordIbltUpdate(m_iblt.getDigest(), erased, inserted);
+
+  for (const auto& prefixUpdate : prefixUpdates) {
+    if (prefixUpdate.oldHash) {
+      eraseFromIblt(*prefixUpdate.oldHash, *prefixUpdate.keyCells);
+    }
+    insertIntoIblt(prefixUpdate.newHash, *prefixUpdate.keyCells);
+  }
+}
+
+void
+ProducerBase::insertIntoIblt(uint64_t hash, ndn::optional<IBLT::KeyCells>& keyCells)
+{
+  keyCells = m_iblt.locate(hash);
+  m_iblt.insert(*keyCells);
+  if (m_strataEstimator) {
+    m_strataEstimator->insert(hash);
+  }
+  if (m_ratelessEncoder) {
+    m_ratelessEncoder->insert(hash);
+  }
+}
+
+void
+ProducerBase::eraseFromIblt(uint64_t hash, ndn::optional<IBLT::KeyCells>& keyCells)
+{
+  if (keyCells && keyCells->key == hash) {
+    m_iblt.erase(*keyCells);
+  }
+  else {
+    m_iblt.erase(hash);
+  }
+  keyCells = ndn::nullopt;
+  if (m_strataEstimator) {
+    m_strataEstimator->erase(hash);
+  }
+  if (m_ratelessEncoder) {
+    m_ratelessEncoder->erase(hash);
+  }
+}
+
+void
+ProducerBase::recordIbltUpdate(uint64_t digest, const std::vector<uint64_t>& erased,
+                               const std::vector<uint64_t>& inserted)
+{
+  if (erased.empty() && inserted.empty()) {
+    return;
+  }
+
+  // The cached differences are to our old IBF
+  m_decodeCache.clear();
+  m_isDecodeScratchCurrent = false;
+
+  m_erasedKeys.insert(m_erasedKeys.end(), erased.begin(), erased.end());
+  m_insertedKeys.insert(m_insertedKeys.end(), inserted.begin(), inserted.end());
+
+  m_ibltHistory.push_back(IbltUpdate{digest, erased, inserted});
+  m_nIbltHistoryKeys += erased.size() + inserted.size();
+  while (m_nIbltHistoryKeys > m_threshold) {
+    const IbltUpdate& oldest = m_ibltHistory.front();
+    m_nIbltHistoryKeys -= oldest.erased.size() + oldest.inserted.size();
+    m_ibltHistory.pop_front();
+  }
+}
+
+ndn::optional<IBLT>
+ProducerBase::getIbltFromHistory(uint64_t digest) const
+{
+  if (digest == m_iblt.getDigest()) {
+    return m_iblt;
+  }
+
+  auto found = std::find_if(m_ibltHistory.rbegin(), m_ibltHistory.rend(),
+                            [digest] (const IbltUpdate& update) { return update.digest == digest; });
+  if (found == m_ibltHistory.rend()) {
+    return ndn::nullopt;
+  }
+
+  // Undo the updates since, newest first
+  IBLT iblt = m_iblt;
+  for (auto it = m_ibltHistory.rbegin(); it != found + 1; ++it) {
+    iblt.eraseBatch(it->inserted);
+    iblt.insertBatch(it->erased);
+  }
+  return iblt;
+}
+
+DecodeResult
+ProducerBase::decodeDifference(const IBLT& iblt, std::vector<uint64_t>& positive,
+                               std::vector<uint64_t>& negative)
+{
+  if (m_autoSizingPeriod != 0 && m_nPeriodDifferences >= m_autoSizingPeriod) {
+    startSizingPeriod();
+  }
+
+  m_isDecodeScratchCurrent = false;
+  if (!iblt.hasDigest()) {
+    DecodeResult result = m_iblt.decodeDifference(iblt, m_decodeScratch, positive, negative,
+                                                  m_threshold);
+    m_isDecodeScratchCurrent = true;
+    recordDifferenceSize(result, positive.size() + negative.size());
+    return result;
+  }
+
+  uint64_t localDigest = m_iblt.getDigest();
+  uint64_t remoteDigest = iblt.getDigest();
+  auto it = std::find_if(m_decodeCache.begin(), m_decodeCache.end(),
+                         [&] (const DecodeCacheEntry& entry) {
+                           return entry.localDigest == localDigest &&
+                                  entry.remoteDigest == remoteDigest &&
+                                  entry.remoteNumCells == iblt.getNumCells();
+                         });
+  if (it != m_decodeCache.end()) {
+    ++m_nDecodeCacheHits;
+    m_decodeCache.splice(m_decodeCache.begin(), m_decodeCache, it);
+    positive = it->positive;
+    negative = it->negative;
+    return DecodeResult::SUCCESS;
+  }
+
+  ++m_nDecodeCacheMisses;
+  DecodeResult result = m_iblt.decodeDifference(iblt, m_decodeScratch, positive, negative,
+                                                m_threshold);
+  m_isDecodeScratchCurrent = true;
+  recordDifferenceSize(result, positive.size() + negative.size());
+
+  // The remote digest is only trusted once the decoded keys account for it
+  if (result == DecodeResult::SUCCESS &&
+      m_iblt.getDigestAfter(positive, negative) == remoteDigest) {
+    if (m_decodeCache.size() >= DECODE_CACHE_SIZE) {
+      m_decodeCache.pop_back();
+    }
+    m_decodeCache.push_front(DecodeCacheEntry{localDigest, remoteDigest, iblt.getNumCells(),
+                                              positive, negative});
+  }
+  return result;
+}
+
+IbltDifference
+ProducerBase::makePendingDifference(const IBLT& iblt, DecodeResult result,
+                                    const std::vector<uint64_t>& positive,
+                                    const std::vector<uint64_t>& negative)
+{
+  if (result == DecodeResult::SUCCESS) {
+    return IbltDifference(m_iblt, iblt, positive, negative, m_threshold);
+  }
+  if (m_isDecodeScratchCurrent) {
+    // The scratch is moved into the difference, the next decode allocates a new one
+    m_isDecodeScratchCurrent = false;
+    return IbltDifference(m_iblt, std::move(m_decodeScratch), result, positive, negative,
+                          m_threshold);
+  }
+  // The cache only keeps the decoded keys, not what is left of the table
+  return IbltDifference(m_iblt, iblt, m_threshold);
+}
+
+void
+ProducerBase::recordDifferenceSize(DecodeResult result, size_t size)
+{
+  size_t recordedSize = result == DecodeResult::SUCCESS ? size : m_threshold;
+  ++m_differenceSizes[recordedSize];
+  if (m_autoSizingPeriod != 0) {
+    ++m_periodDifferenceSizes[recordedSize];
+    ++m_nPeriodDifferences;
+  }
+}
+
+void
+ProducerBase::setAutoSizing(size_t nDifferences, double quantile)
+{
+  m_autoSizingPeriod = nDifferences;
+  m_autoSizingQuantile = quantile;
+  m_periodDifferenceSizes.clear();
+  m_nPeriodDifferences = 0;
+}
+
+void
+ProducerBase::startSizingPeriod()
+{
+  size_t target = pickExpectedNumEntries(m_periodDifferenceSizes, m_expectedNumEntries,
+                                         m_autoSizingQuantile);
+  m_periodDifferenceSizes.clear();
+  m_nPeriodDifferences = 0;
+
+  // The smallest size that reaches target among the sizes that fold to the constructed one,
+  // or else the largest of them
+  size_t picked = m_constructedNumEntries;
+  for (size_t factor = MAX_AUTO_SIZING_FACTOR; factor >= 1; factor /= 2) {
+    size_t size = m_constructedNumEntries / factor;
+    if (size >= target && size * factor == m_constructedNumEntries && isFoldableSize(size)) {
+      picked = size;
+      break;
+    }
+  }
+  for (size_t factor = 2; picked < target && factor <= MAX_AUTO_SIZING_FACTOR; factor *= 2) {
+    size_t size = m_constructedNumEntries * factor;
+    if (isFoldableSize(size)) {
+      picked = size;
+    }
+  }
+  resizeIblt(picked);
+}
+
+bool
+ProducerBase::isFoldableSize(size_t expectedNumEntries) const
+{
+  IBLT iblt(expectedNumEntries, m_iblt.getCompressionScheme(), m_iblt.getKeyWidth(),
+            m_iblt.getParameters());
+  return iblt.isFoldableWith(m_nConstructedCells);
+}
+
+void
+ProducerBase::resizeIblt(size_t expectedNumEntries)
+{
+  if (expectedNumEntries == m_expectedNumEntries) {
+    return;
+  }
+  NDN_LOG_DEBUG("Resizing IBF from " << m_expectedNumEntries << " to " << expectedNumEntries
+                << " expected entries");
+
+  IBLT iblt(expectedNumEntries, m_iblt.getCompressionScheme(), m_iblt.getKeyWidth(),
+            m_iblt.getParameters());
+  // The cells of each key are located again in the new table
+  for (const auto& entry : m_hash2prefix) {
+    ndn::optional<IBLT::KeyCells>& keyCells = m_prefixes.find(entry.second)->second.keyCells;
+    keyCells = iblt.locate(entry.first);
+    iblt.insert(*keyCells);
+  }
+  m_iblt = std::move(iblt);
+  m_expectedNumEntries = expectedNumEntries;
+  m_threshold = expectedNumEntries / 2;
+  // The scratch holds what is left of a decode against the old table
+  m_isDecodeScratchCurrent = false;
+}
+
+size_t
+ProducerBase::pickExpectedNumEntries(const DifferenceSizeHistogram& histogram,
+                                     size_t defaultNumEntries, double quantile)
+{
+  uint64_t total = 0;
+  for (const auto& size : histogram) {
+    total += size.second;
+  }
+  if (total == 0) {
+    return defaultNumEntries;
+  }
+
+  // Smallest size that at least quantile of the differences do not exceed
+  uint64_t covered = 0;
+  size_t quantileSize = 0;
+  for (const auto& size : histogram) {
+    quantileSize = size.first;
+    covered += size.second;
+    if (covered >= quantile * total) {
+      break;
+    }
+  }
+
+  size_t expectedNumEntries = MIN_PICKED_NUM_ENTRIES;
+  while (expectedNumEntries / 2 < quantileSize) {
+    expectedNumEntries *= 2;
+  }
+  return expectedNumEntries;
+}
+
+bool
+ProducerBase::updatePrefixMaps(const ndn::Name& prefix, uint64_t seq,
+                               ndn::optional<uint64_t>& oldHash, uint64_t& newHash,
+                               ndn::optional<IBLT::KeyCells>*& keyCells)
 {
   NDN_LOG_DEBUG("UpdateSeq: " << prefix << " " << seq);
 
   uint64_t oldSeq;
   auto it = m_prefixes.find(prefix);
   if (it != m_prefixes.end()) {
-    oldSeq = it->second;
+    oldSeq = it->second.seq;
   }
   else {
     NDN_LOG_WARN("Prefix not found in m_prefixes");
-    return;
+    return false;
   }
 
   if (oldSeq >= seq) {
     NDN_LOG_WARN("Update has lower/equal seq no for prefix, doing nothing!");
-    return;
+    return false;
   }
 
   // Delete the last sequence prefix from the iblt
@@ -108,20 +455,34 @@ ProducerBase::updateSeqNo(const ndn::Name& prefix, uint64_t seq)
     ndn::Name prefixWithSeq = ndn::Name(prefix).appendNumber(oldSeq);
     auto hashIt = m_prefix2hash.find(prefixWithSeq);
     if (hashIt != m_prefix2hash.end()) {
-      uint32_t hash = hashIt->second;
+      oldHash = hashIt->second;
       m_prefix2hash.erase(hashIt);
-      m_hash2prefix.erase(hash);
-      m_iblt.erase(hash);
+      m_hash2prefix.erase(*oldHash);
     }
   }
 
   // Insert the new seq no
-  it->second = seq;
+  it->second.seq = seq;
+  keyCells = &it->second.keyCells;
   ndn::Name prefixWithSeq = ndn::Name(prefix).appendNumber(seq);
-  uint32_t newHash = murmurHash3(N_HASHCHECK, prefixWithSeq.toUri());
+  newHash = hashPrefixWithSeq(prefixWithSeq);
   m_prefix2hash[prefixWithSeq] = newHash;
   m_hash2prefix[newHash] = prefix;
-  m_iblt.insert(newHash);
+  return true;
+}
+
+uint64_t
+ProducerBase::hashPrefixWithSeq(const ndn::Name& prefixWithSeq) const
+{
+  bool is64Bit = m_iblt.getKeyWidth() == KeyWidth::BITS_64;
+  if (m_iblt.getParameters().hashFamily == HashFamily::WYHASH) {
+    uint64_t hash = wyhash(N_HASHCHECK, prefixWithSeq.toUri());
+    return is64Bit ? hash : static_cast<uint32_t>(hash);
+  }
+  if (is64Bit) {
+    return murmurHash3x64(N_HASHCHECK, prefixWithSeq.toUri());
+  }
+  return murmurHash3(N_HASHCHECK, prefixWithSeq.toUri());
 }
 
 void
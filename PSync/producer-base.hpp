@@ -23,6 +23,8 @@
 #include "PSync/detail/access-specifiers.hpp"
 #include "PSync/detail/bloom-filter.hpp"
 #include "PSync/detail/iblt.hpp"
+#include "PSync/detail/rateless-iblt.hpp"
+#include "PSync/detail/strata-estimator.hpp"
 #include "PSync/detail/util.hpp"
 #include "PSync/segment-publisher.hpp"
 
@@ -33,6 +35,8 @@
 #include <ndn-cxx/security/key-chain.hpp>
 #include <ndn-cxx/security/validator-config.hpp>
 
+#include <deque>
+#include <list>
 #include <map>
 #include <unordered_set>
 
@@ -43,6 +47,9 @@ using namespace ndn::time_literals;
 const ndn::time::milliseconds SYNC_REPLY_FRESHNESS = 1_s;
 const ndn::time::milliseconds HELLO_REPLY_FRESHNESS = 1_s;
 
+// Number of times each size of difference to the IBFs of others was seen
+using DifferenceSizeHistogram = std::map<size_t, uint64_t>;
+
 /**
  * @brief Base class for PartialProducer and FullProducer
  *
@@ -60,19 +67,26 @@ PSYNC_PUBLIC_WITH_TESTS_ELSE_PROTECTED:
   /**
    * @brief constructor
    *
-   * @param expectedNumEntries expected number entries in IBF
+   * @param expectedNumEntries expected number entries in IBF, used as given
+   *        unless auto-sizing is turned on (see setAutoSizing)
    * @param face application's face
    * @param syncPrefix The prefix of the sync group
    * @param userPrefix The prefix of the first user in the group
    * @param syncReplyFreshness freshness of sync data
    * @param helloReplyFreshness freshness of hello data
+   * @param ibltCompression compression scheme for our IBF in interest and data names
+   * @param keyWidth width of the prefix/seq hashes in the IBF, same for the whole sync group
+   * @param ibltParameters geometry of the IBF, see IbltParameters
    */
   ProducerBase(size_t expectedNumEntries,
                ndn::Face& face,
                const ndn::Name& syncPrefix,
                const ndn::Name& userPrefix,
                ndn::time::milliseconds syncReplyFreshness = SYNC_REPLY_FRESHNESS,
-               ndn::time::milliseconds helloReplyFreshness = HELLO_REPLY_FRESHNESS);
+               ndn::time::milliseconds helloReplyFreshness = HELLO_REPLY_FRESHNESS,
+               CompressionScheme ibltCompression = CompressionScheme::DEFAULT,
+               KeyWidth keyWidth = KeyWidth::DEFAULT,
+               const IbltParameters& ibltParameters = IbltParameters());
 public:
   /**
    * @brief Returns the current sequence number of the given prefix
@@ -86,7 +100,7 @@ public:
     if (it == m_prefixes.end()) {
       return ndn::nullopt;
     }
-    return it->second;
+    return it->second.seq;
   }
 
   /**
@@ -113,6 +127,69 @@ public:
   void
   removeUserNode(const ndn::Name& prefix);
 
+  /**
+   * @brief Returns the number of differences to the IBFs of others answered from the cache
+   */
+  uint64_t
+  getNDecodeCacheHits() const
+  {
+    return m_nDecodeCacheHits;
+  }
+
+  /**
+   * @brief Returns the number of differences to the IBFs of others that had to be decoded
+   */
+  uint64_t
+  getNDecodeCacheMisses() const
+  {
+    return m_nDecodeCacheMisses;
+  }
+
+  /**
+   * @brief Returns the sizes of the differences to the IBFs of others decoded so far
+   *
+   * A difference that could not be decoded counts as threshold entries.
+   */
+  const DifferenceSizeHistogram&
+  getDifferenceSizes() const
+  {
+    return m_differenceSizes;
+  }
+
+  /**
+   * @brief Resize our IBF from the sizes of the differences we decode
+   *
+   * The decoded differences are counted in periods of nDifferences.  Once a period is
+   * over, the IBF is resized before the next decode, to the smallest size whose
+   * threshold covers the given quantile of the differences of that period
+   * (see pickExpectedNumEntries).  The size is kept to expectedNumEntries of the
+   * constructor times or divided by a power of two, at most 4, so that the IBFs of
+   * members constructed with the same expectedNumEntries fold to one another and
+   * are never more than IBLT::MAX_RECEIVED_GROWTH times apart, whatever they picked.
+   *
+   * Off by default.
+   *
+   * @param nDifferences number of decoded differences per period, 0 turns auto-sizing off
+   * @param quantile fraction of the differences the picked size must decode
+   */
+  void
+  setAutoSizing(size_t nDifferences, double quantile = 0.99);
+
+  /**
+   * @brief Pick the expected number of entries of the IBF from the difference sizes
+   *        seen before
+   *
+   * The pick is a power of two, at least 64, whose threshold (half of it) covers
+   * the given quantile of the differences.
+   *
+   * @param histogram difference sizes seen, see getDifferenceSizes
+   * @param defaultNumEntries returned if histogram is empty
+   * @param quantile fraction of the differences the pick must decode
+   */
+  static size_t
+  pickExpectedNumEntries(const DifferenceSizeHistogram& histogram, size_t defaultNumEntries,
+                         double quantile = 0.99);
+
 PSYNC_PUBLIC_WITH_TESTS_ELSE_PROTECTED:
   /**
    * @brief Update m_prefixes and IBF with the given prefix and seq
@@ -128,12 +205,45 @@ PSYNC_PUBLIC_WITH_TESTS_ELSE_PROTECTED:
   void
   updateSeqNo(const ndn::Name& prefix, uint64_t seq);
 
+  /**
+   * @brief Apply several prefix/seq updates at once
+   *
+   * Same as calling updateSeqNo for each pair in order, but the IBF is
+   * updated with one batch erase and one batch insert at the end.
+   *
+   * @param updates prefix and sequence number pairs
+   */
+  void
+  updateSeqNo(const std::vector<std::pair<ndn::Name, uint64_t>>& updates);
+
   bool
   isUserNode(const ndn::Name& prefix) const
   {
     return m_prefixes.find(prefix) != m_prefixes.end();
   }
 
+  /**
+   * @brief Bring the differences between our IBF and the IBFs of pending sync interests
+   *        up to date with the updates to our IBF since the last call
+   *
+   * @param pendingEntries map to pending entries with an IbltDifference named difference
+   */
+  template<typename PendingEntries>
+  void
+  updatePendingDifferences(PendingEntries& pendingEntries)
+  {
+    for (auto& entry : pendingEntries) {
+      for (uint64_t key : m_erasedKeys) {
+        entry.second.difference.erase(key);
+      }
+      for (uint64_t key : m_insertedKeys) {
+        entry.second.difference.insert(key);
+      }
+    }
+    m_erasedKeys.clear();
+    m_insertedKeys.clear();
+  }
+
   /**
    * @brief Sends a data packet with content type nack
    *
@@ -154,20 +264,195 @@ PSYNC_PUBLIC_WITH_TESTS_ELSE_PROTECTED:
   void
   onRegisterFailed(const ndn::Name& prefix, const std::string& msg) const;
 
+  /**
+   * @brief Hash prefix/seq to the key stored in the IBF, of the IBF's key width and
+   *        with its hash family
+   */
+  uint64_t
+  hashPrefixWithSeq(const ndn::Name& prefixWithSeq) const;
+
+  /**
+   * @brief Get our IBF as it was when it had the given digest
+   *
+   * Lets the others refer to an IBF we had recently by its digest only
+   * (see IBLT::makeDigestReference).  The history goes back threshold updates,
+   * the difference to an older IBF could not be decoded anyway.
+   *
+   * @return nullopt if our IBF did not have the digest during that time
+   */
+  ndn::optional<IBLT>
+  getIbltFromHistory(uint64_t digest) const;
+
+  /**
+   * @brief Decode the difference between our IBF and iblt, up to m_threshold entries
+   *
+   * Many others tend to send the same IBF, so the last few results are cached by the
+   * digests of both IBFs (if iblt has one) until our IBF changes.  The digest of iblt
+   * is the one the other side sent, so only complete decodes that account for it are
+   * cached: a table that does not match its digest is never served to others.
+   *
+   * @param iblt the IBF of another
+   * @param positive receives the entries in our IBF but not in iblt
+   * @param negative receives the entries in iblt but not in our IBF
+   */
+  DecodeResult
+  decodeDifference(const IBLT& iblt, std::vector<uint64_t>& positive,
+                   std::vector<uint64_t>& negative);
+
+  /**
+   * @brief Make the difference of a pending sync interest from the result of the
+   *        decodeDifference call for its IBF, which must be the last one
+   *
+   * A complete decode leaves nothing to keep; otherwise what is left of the table
+   * is taken from m_decodeScratch, or decoded again if the result came from the cache.
+   */
+  IbltDifference
+  makePendingDifference(const IBLT& iblt, DecodeResult result,
+                        const std::vector<uint64_t>& positive,
+                        const std::vector<uint64_t>& negative);
+
+private:
+  /**
+   * @brief Update m_prefixes, m_prefix2hash and m_hash2prefix with the given prefix and seq
+   *
+   * Does not touch the IBF, the caller has to erase oldHash (if set) from it
+   * and insert newHash into it.
+   *
+   * @param keyCells set to the cells of the prefix in m_iblt, to erase oldHash and
+   *        insert newHash with
+   * @return false if the update is ignored (unknown prefix or old seq)
+   */
+  bool
+  updatePrefixMaps(const ndn::Name& prefix, uint64_t seq,
+                   ndn::optional<uint64_t>& oldHash, uint64_t& newHash,
+                   ndn::optional<IBLT::KeyCells>*& keyCells);
+
+  /**
+   * @brief Record that erased and inserted were erased from and inserted into m_iblt,
+   *        whose digest was digest before, for the pending differences and the history
+   */
+  void
+  recordIbltUpdate(uint64_t digest, const std::vector<uint64_t>& erased,
+                   const std::vector<uint64_t>& inserted);
+
+  /**
+   * @brief Count a decoded difference of size entries in m_differenceSizes,
+   *        and in the current auto-sizing period
+   */
+  void
+  recordDifferenceSize(DecodeResult result, size_t size);
+
+  /**
+   * @brief Pick the size of our IBF from the differences of the auto-sizing period
+   *        that is over, and start the next period
+   */
+  void
+  startSizingPeriod();
+
+  /**
+   * @brief Whether an IBF of expectedNumEntries folds to the IBF we were constructed with
+   */
+  bool
+  isFoldableSize(size_t expectedNumEntries) const;
+
+  /**
+   * @brief Replace m_iblt by an IBF of expectedNumEntries that holds the same keys
+   *
+   * The digest stays the same, so the history and the decode cache stay valid.
+   */
+  void
+  resizeIblt(size_t expectedNumEntries);
+
+  /**
+   * @brief Insert hash, the new hash of a prefix, into m_iblt and keep its cells
+   *        in keyCells for when it is erased
+   *
+   * Also inserts it into m_strataEstimator and m_ratelessEncoder, if we keep them.
+   */
+  void
+  insertIntoIblt(uint64_t hash, ndn::optional<IBLT::KeyCells>& keyCells);
+
+  /**
+   * @brief Erase hash, the old hash of a prefix, from m_iblt through the cells kept
+   *        in keyCells, or by hashing it again if they are not its cells
+   *
+   * Also erases it from m_strataEstimator and m_ratelessEncoder, if we keep them.
+   */
+  void
+  eraseFromIblt(uint64_t hash, ndn::optional<IBLT::KeyCells>& keyCells);
+
+private:
+  struct IbltUpdate
+  {
+    uint64_t digest;
+    std::vector<uint64_t> erased;
+    std::vector<uint64_t> inserted;
+  };
+
+  // Recent updates to m_iblt, oldest first, from which our recent IBFs are rebuilt
+  std::deque<IbltUpdate> m_ibltHistory;
+  // Number of keys in m_ibltHistory
+  size_t m_nIbltHistoryKeys = 0;
+
+  struct DecodeCacheEntry
+  {
+    uint64_t localDigest;
+    uint64_t remoteDigest;
+    // Folded IBFs have the same digest but may decode differently
+    size_t remoteNumCells;
+    // Only complete decodes are cached
+    std::vector<uint64_t> positive;
+    std::vector<uint64_t> negative;
+  };
+
+  // Decoded differences, most recently used first
+  std::list<DecodeCacheEntry> m_decodeCache;
+  uint64_t m_nDecodeCacheHits = 0;
+  uint64_t m_nDecodeCacheMisses = 0;
+
+  DifferenceSizeHistogram m_differenceSizes;
+
+  // Auto-sizing, see setAutoSizing; off while the period is 0
+  size_t m_autoSizingPeriod = 0;
+  double m_autoSizingQuantile = 0.99;
+  DifferenceSizeHistogram m_periodDifferenceSizes;
+  size_t m_nPeriodDifferences = 0;
+  // Size the IBF was constructed with, the picked sizes fold to it
+  size_t m_constructedNumEntries;
+  size_t m_nConstructedCells;
+
 PSYNC_PUBLIC_WITH_TESTS_ELSE_PROTECTED:
   IBLT m_iblt;
+  // Holds the same keys as m_iblt, only kept by producers that use it (see FullProducer)
+  ndn::optional<StrataEstimator> m_strataEstimator;
+  // Holds the same keys as m_iblt, only kept once rateless sync is used (see FullProducer)
+  ndn::optional<RatelessEncoder> m_ratelessEncoder;
+  // Reused by the decodes of the differences to the IBFs of the others
+  DecodeScratch m_decodeScratch;
+  // Whether m_decodeScratch holds what is left of the last decode (not a cache hit)
+  bool m_isDecodeScratchCurrent = false;
+  // Keys erased from and inserted into m_iblt since the last updatePendingDifferences
+  std::vector<uint64_t> m_erasedKeys;
+  std::vector<uint64_t> m_insertedKeys;
   uint32_t m_expectedNumEntries;
   // Threshold is used check if the differences are greater
   // than it and whether we need to update the other side.
   uint32_t m_threshold;
 
-  // prefix and sequence number
-  std::map<ndn::Name, uint64_t> m_prefixes;
+  struct PrefixInfo
+  {
+    uint64_t seq = 0;
+    // Cells in m_iblt of the current hash of the prefix, so that erasing it needs no hashing
+    ndn::optional<IBLT::KeyCells> keyCells;
+  };
+
+  // prefix and its sequence number
+  std::map<ndn::Name, PrefixInfo> m_prefixes;
   // Just for looking up hash faster (instead of calculating it again)
   // Only used in updateSeqNo, prefix/seqNo is the key
-  std::map<ndn::Name, uint32_t> m_prefix2hash;
+  std::map<ndn::Name, uint64_t> m_prefix2hash;
   // Value is prefix (and not prefix/seqNo)
-  std::map<uint32_t, ndn::Name> m_hash2prefix;
+  std::map<uint64_t, ndn::Name> m_hash2prefix;
 
   ndn::Face& m_face;
   ndn::KeyChain m_keyChain;
@@ -0,0 +1,189 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014-2019,  The University of Memphis
+ *
+ * This file is part of PSync.
+ * See AUTHORS.md for complete list of PSync authors and contributors.
+ *
+ * PSync is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU Lesser General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * PSync is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along with
+ * PSync, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#define BOOST_TEST_MODULE PSync Hash Benchmark
+
+#include "PSync/detail/bloom-filter.hpp"
+#include "PSync/detail/iblt.hpp"
+#include "PSync/detail/util.hpp"
+
+#include "tests/boost-test.hpp"
+#include "tests/benchmarks/timed-execute.hpp"
+
+#include <iostream>
+
+namespace psync {
+namespace tests {
+
+// Sync prefixes of the lengths seen in practice, from a bare node prefix
+// to an application prefix with a long device identifier
+const std::vector<std::string> PREFIXES = {
+  "/a",
+  "/ndn/edu/memphis/alice",
+  "/ndn/edu/ucla/remap/chat/general/alice-laptop",
+  "/localhop/ndn/edu/ucla/cs/irl/psync/group-chat/rooms/general/participants/"
+    "alice-laptop-5f3c2a/sessions/1571234567",
+  "/ndn/org/example/iot/building-12/floor-3/room-301/sensors/temperature/"
+    "device-8c1f64a2b7e94d05/firmware-2.3.1/readings/calibrated/celsius/"
+    "sha256digest=4a5b6c7d8e9f00112233445566778899aabbccddeeff00112233445566778899",
+};
+
+// Repeat each measurement enough times that the clock resolution does not matter
+const size_t N_NAMES = 1000;
+const int REPEAT = 1000;
+
+template<typename Hash>
+static double
+nsPerHash(const std::vector<std::string>& uris, const Hash& hash)
+{
+  uint64_t sum = 0;
+  auto time = timedExecute([&] {
+    for (int i = 0; i < REPEAT; i++) {
+      for (const auto& uri : uris) {
+        sum += hash(uri);
+      }
+    }
+  });
+  // Keep the hashes from being optimized out
+  BOOST_CHECK_NE(sum, 1);
+  return static_cast<double>(time.count()) / (REPEAT * uris.size());
+}
+
+BOOST_AUTO_TEST_SUITE(HashBenchmark)
+
+BOOST_AUTO_TEST_CASE(NameHashing)
+{
+  // Hashing prefix/seq to a key, as ProducerBase::hashPrefixWithSeq does
+  std::cout << "uri-bytes\tmurmur3(ns)\tmurmur3x64(ns)\twyhash(ns)\tspeedup-64" << std::endl;
+  for (const auto& prefix : PREFIXES) {
+    std::vector<std::string> uris;
+    size_t nBytes = 0;
+    for (size_t seq = 0; seq < N_NAMES; seq++) {
+      uris.push_back(ndn::Name(prefix).appendNumber(1000000 + seq).toUri());
+      nBytes += uris.back().size();
+    }
+
+    double murmur = nsPerHash(uris, [] (const std::string& uri) {
+      return murmurHash3(N_HASHCHECK, uri);
+    });
+    double murmur64 = nsPerHash(uris, [] (const std::string& uri) {
+      return murmurHash3x64(N_HASHCHECK, uri);
+    });
+    double wy = nsPerHash(uris, [] (const std::string& uri) {
+      return wyhash(N_HASHCHECK, uri);
+    });
+    std::cout << nBytes / uris.size() << "\t" << murmur << "\t" << murmur64 << "\t"
+              << wy << "\t" << murmur64 / wy << std::endl;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(KeyHashing)
+{
+  const size_t N_KEYS = 100000;
+
+  // Hashing the keys of an IBF to their cells and check sums, alone and
+  // as part of building an IBF
+  std::cout << "width\tfamily\thashKey(ns)\tinsertBatch(us)" << std::endl;
+  for (KeyWidth keyWidth : {KeyWidth::BITS_32, KeyWidth::BITS_64}) {
+    std::vector<uint64_t> keys;
+    for (size_t i = 0; i < N_KEYS; i++) {
+      uint64_t key = murmurHash3x64(N_HASHCHECK, ndn::Name("/ndn/edu/memphis/alice")
+                                                   .appendNumber(i).toUri());
+      keys.push_back(keyWidth == KeyWidth::BITS_64 ? key : static_cast<uint32_t>(key));
+    }
+
+    for (HashFamily hashFamily : {HashFamily::MURMUR3, HashFamily::WYHASH}) {
+      uint64_t sum = 0;
+      auto hashTime = timedExecute([&] {
+        for (int i = 0; i < REPEAT / 100; i++) {
+          for (uint64_t key : keys) {
+            sum += hashKey(i, key, keyWidth, hashFamily);
+          }
+        }
+      });
+      BOOST_CHECK_NE(sum, 1);
+
+      IbltParameters parameters;
+      parameters.hashFamily = hashFamily;
+      IBLT iblt(N_KEYS, CompressionScheme::NONE, keyWidth, parameters);
+      auto insertTime = timedExecute([&] {
+        iblt.insertBatch(keys);
+      });
+
+      using ndn::time::duration_cast;
+      using ndn::time::microseconds;
+      std::cout << static_cast<int>(keyWidth) << "\t"
+                << (hashFamily == HashFamily::WYHASH ? "wyhash" : "murmur3") << "\t"
+                << static_cast<double>(hashTime.count()) / (REPEAT / 100 * N_KEYS) << "\t"
+                << duration_cast<microseconds>(insertTime).count() << std::endl;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(BloomFilterContains)
+{
+  // A partial sync consumer's Bloom filter: 10 salts for a false positive probability of 0.001
+  const unsigned int N_SUBSCRIPTIONS = 100;
+  const size_t N_SALTS = 10;
+
+  std::vector<uint32_t> salts;
+  for (uint32_t i = 0; i < N_SALTS; i++) {
+    salts.push_back(murmurHash3(i, i));
+  }
+
+  std::cout << "uri-bytes\tper-salt(ns)\tmulti-seed(ns)\tspeedup\tcontains(ns)" << std::endl;
+  for (const auto& prefix : PREFIXES) {
+    std::vector<std::string> uris;
+    size_t nBytes = 0;
+    BloomFilter bf(N_SUBSCRIPTIONS, 0.001);
+    for (size_t i = 0; i < N_NAMES; i++) {
+      uris.push_back(ndn::Name(prefix).appendNumber(i).toUri());
+      nBytes += uris.back().size();
+      if (i < N_SUBSCRIPTIONS) {
+        bf.insert(uris.back());
+      }
+    }
+    // Every prefix is looked up, as PartialProducer::onSyncInterest does for the positives
+    uris.resize(N_SUBSCRIPTIONS);
+
+    uint32_t hashes[N_SALTS];
+    double perSalt = nsPerHash(uris, [&] (const std::string& uri) {
+      uint32_t sum = 0;
+      for (uint32_t salt : salts) {
+        sum += murmurHash3(salt, uri);
+      }
+      return sum;
+    });
+    double multiSeed = nsPerHash(uris, [&] (const std::string& uri) {
+      murmurHash3(salts.data(), salts.size(), reinterpret_cast<const uint8_t*>(uri.data()),
+                  uri.size(), hashes);
+      return hashes[0] + hashes[N_SALTS - 1];
+    });
+    double contains = nsPerHash(uris, [&] (const std::string& uri) {
+      return bf.contains(uri);
+    });
+    std::cout << nBytes / N_NAMES << "\t" << perSalt << "\t" << multiSeed << "\t"
+              << perSalt / multiSeed << "\t" << contains << std::endl;
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // namespace tests
+} // namespace psync
@@ -0,0 +1,490 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014-2019,  The University of Memphis
+ *
+ * This file is part of PSync.
+ * See AUTHORS.md for complete list of PSync authors and contributors.
+ *
+ * PSync is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU Lesser General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * PSync is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along with
+ * PSync, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#define BOOST_TEST_MODULE PSync IBLT Benchmark
+
+#include "PSync/detail/iblt.hpp"
+#include "PSync/detail/util.hpp"
+
+#include "tests/boost-test.hpp"
+#include "tests/benchmarks/timed-execute.hpp"
+
+#include <iostream>
+
+namespace psync {
+namespace tests {
+
+// Peel by rescanning the whole table until a pass finds nothing pure
+// (the decoder used before the work list), used as the baseline
+static bool
+rescanPeel(std::vector<HashTableEntry> table,
+           std::set<uint64_t>& positive, std::set<uint64_t>& negative)
+{
+  size_t bucketsPerHash = table.size() / N_HASH;
+  size_t nErased = 0;
+  do {
+    nErased = 0;
+    for (auto& entry : table) {
+      if (entry.isPure()) {
+        int32_t count = entry.count;
+        uint32_t key = entry.keySum;
+        if (count == 1) {
+          positive.insert(key);
+        }
+        else {
+          negative.insert(key);
+        }
+        for (size_t i = 0; i < N_HASH; i++) {
+          HashTableEntry& cell = table[i * bucketsPerHash + (murmurHash3(i, key) % bucketsPerHash)];
+          cell.count -= count;
+          cell.keySum ^= key;
+          cell.keyCheck ^= murmurHash3(N_HASHCHECK, key);
+        }
+        ++nErased;
+      }
+    }
+  } while (nErased > 0);
+
+  for (const auto& entry : table) {
+    if (!entry.isEmpty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+BOOST_AUTO_TEST_SUITE(IbltBenchmark)
+
+BOOST_AUTO_TEST_CASE(ListEntries)
+{
+  const int REPEAT = 3;
+
+  std::cout << "cells\tdiff\trescan(us)\tworklist(us)\tspeedup" << std::endl;
+  for (size_t expectedNumEntries : {6666, 66666, 666666}) {
+    // Near the decodable load (~0.8 keys per cell for 3 hashes) the peel needs many passes
+    for (size_t nDiff : {expectedNumEntries / 10, expectedNumEntries / 2, expectedNumEntries}) {
+      IBLT ownIBF(expectedNumEntries);
+      IBLT rcvdIBF(expectedNumEntries);
+      for (size_t i = 0; i < nDiff; i++) {
+        if (i % 2 == 0) {
+          ownIBF.insert(murmurHash3(N_HASHCHECK, i));
+        }
+        else {
+          rcvdIBF.insert(murmurHash3(N_HASHCHECK, i));
+        }
+      }
+      IBLT diff = ownIBF - rcvdIBF;
+      auto table = diff.getHashTable();
+
+      ndn::time::nanoseconds rescanTime = ndn::time::nanoseconds::zero();
+      ndn::time::nanoseconds workListTime = ndn::time::nanoseconds::zero();
+      for (int i = 0; i < REPEAT; i++) {
+        std::set<uint64_t> expectedPositive, expectedNegative, positive, negative;
+        bool expected = false, actual = false;
+        rescanTime += timedExecute([&] {
+          expected = rescanPeel(table, expectedPositive, expectedNegative);
+        });
+        workListTime += timedExecute([&] {
+          actual = diff.listEntries(positive, negative);
+        });
+        BOOST_CHECK_EQUAL(actual, expected);
+        BOOST_CHECK(positive == expectedPositive);
+        BOOST_CHECK(negative == expectedNegative);
+      }
+
+      auto rescanUs = ndn::time::duration_cast<ndn::time::microseconds>(rescanTime).count() / REPEAT;
+      auto workListUs = ndn::time::duration_cast<ndn::time::microseconds>(workListTime).count() / REPEAT;
+      std::cout << table.size() << "\t" << nDiff << "\t" << rescanUs << "\t"
+                << workListUs << "\t" << static_cast<double>(rescanUs) / workListUs << std::endl;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SubtractAndCompare)
+{
+  const int REPEAT = 20;
+
+  std::cout << "cells\taos-subtract(us)\tsubtract(us)\tequal(us)\tpeel-empty(us)" << std::endl;
+  for (size_t expectedNumEntries : {6666, 66666, 666666}) {
+    IBLT ownIBF(expectedNumEntries);
+    for (size_t i = 0; i < expectedNumEntries; i++) {
+      ownIBF.insert(murmurHash3(N_HASHCHECK, i));
+    }
+    IBLT rcvdIBF = ownIBF;
+
+    // Interleaved cells walked one field at a time (the layout used before the arrays)
+    auto ownTable = ownIBF.getHashTable();
+    auto rcvdTable = rcvdIBF.getHashTable();
+    auto aosTime = timedExecute([&] {
+      for (int i = 0; i < REPEAT; i++) {
+        auto result = ownTable;
+        for (size_t j = 0; j < result.size(); j++) {
+          result.at(j).count -= rcvdTable.at(j).count;
+          result.at(j).keySum ^= rcvdTable.at(j).keySum;
+          result.at(j).keyCheck ^= rcvdTable.at(j).keyCheck;
+        }
+      }
+    });
+
+    IBLT diff(expectedNumEntries);
+    auto subtractTime = timedExecute([&] {
+      for (int i = 0; i < REPEAT; i++) {
+        diff = ownIBF - rcvdIBF;
+      }
+    });
+
+    bool isEqual = false;
+    auto equalTime = timedExecute([&] {
+      for (int i = 0; i < REPEAT; i++) {
+        isEqual = ownIBF == rcvdIBF;
+      }
+    });
+    BOOST_CHECK(isEqual);
+
+    std::set<uint64_t> positive, negative;
+    auto peelTime = timedExecute([&] {
+      for (int i = 0; i < REPEAT; i++) {
+        BOOST_CHECK(diff.listEntries(positive, negative));
+      }
+    });
+
+    using ndn::time::duration_cast;
+    using ndn::time::microseconds;
+    std::cout << ownTable.size() << "\t"
+              << duration_cast<microseconds>(aosTime).count() / REPEAT << "\t"
+              << duration_cast<microseconds>(subtractTime).count() / REPEAT << "\t"
+              << duration_cast<microseconds>(equalTime).count() / REPEAT << "\t"
+              << duration_cast<microseconds>(peelTime).count() / REPEAT << std::endl;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(DecodeDifference)
+{
+  const int REPEAT = 20;
+
+  std::cout << "cells\tdiff\tsubtract+list(us)\tdecodeDifference(us)" << std::endl;
+  for (size_t expectedNumEntries : {6666, 66666, 666666}) {
+    // Few differences, as between sync interests of a group in sync
+    for (size_t nDiff : {size_t(10), expectedNumEntries / 10}) {
+      IBLT ownIBF(expectedNumEntries);
+      for (size_t i = 0; i < expectedNumEntries; i++) {
+        ownIBF.insert(murmurHash3(N_HASHCHECK, i));
+      }
+      IBLT rcvdIBF = ownIBF;
+      for (size_t i = 0; i < nDiff; i++) {
+        rcvdIBF.erase(murmurHash3(N_HASHCHECK, i));
+      }
+
+      auto subtractTime = timedExecute([&] {
+        for (int i = 0; i < REPEAT; i++) {
+          std::set<uint64_t> positive, negative;
+          IBLT diff = ownIBF - rcvdIBF;
+          BOOST_CHECK(diff.listEntries(positive, negative));
+        }
+      });
+
+      DecodeScratch scratch;
+      std::vector<uint64_t> positive, negative;
+      auto decodeTime = timedExecute([&] {
+        for (int i = 0; i < REPEAT; i++) {
+          BOOST_CHECK(ownIBF.decodeDifference(rcvdIBF, scratch, positive, negative) ==
+                      DecodeResult::SUCCESS);
+        }
+      });
+      BOOST_CHECK_EQUAL(positive.size(), nDiff);
+
+      using ndn::time::duration_cast;
+      using ndn::time::microseconds;
+      std::cout << ownIBF.getNumCells() << "\t" << nDiff << "\t"
+                << duration_cast<microseconds>(subtractTime).count() / REPEAT << "\t"
+                << duration_cast<microseconds>(decodeTime).count() / REPEAT << std::endl;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(DecodeFailures)
+{
+  const int TRIALS = 2000;
+  const size_t EXPECTED_NUM_ENTRIES = 100;
+
+  // Near and past the capacity of the table a cell holding several keys may be
+  // taken for a pure one; count the decodes listing keys that are not in the difference
+  std::cout << "diff\tsuccess\tfailed\tspurious\tdecode(us)" << std::endl;
+  uint32_t seed = 0;
+  for (size_t nDiff : {60, 80, 100, 150, 300}) {
+    int nSuccess = 0, nFailed = 0, nSpurious = 0;
+    ndn::time::nanoseconds decodeTime(0);
+    for (int trial = 0; trial < TRIALS; trial++) {
+      IBLT own(EXPECTED_NUM_ENTRIES);
+      IBLT rcvd(EXPECTED_NUM_ENTRIES);
+      std::set<uint64_t> ownOnly, rcvdOnly;
+      for (size_t i = 0; i < nDiff; i++) {
+        uint64_t key = murmurHash3(N_HASHCHECK, seed++);
+        if (i % 2 == 0) {
+          own.insert(key);
+          ownOnly.insert(key);
+        }
+        else {
+          rcvd.insert(key);
+          rcvdOnly.insert(key);
+        }
+      }
+
+      DecodeScratch scratch;
+      std::vector<uint64_t> positive, negative;
+      DecodeResult result;
+      decodeTime += timedExecute([&] {
+        result = own.decodeDifference(rcvd, scratch, positive, negative);
+      });
+      result == DecodeResult::SUCCESS ? ++nSuccess : ++nFailed;
+      for (uint64_t key : positive) {
+        nSpurious += ownOnly.count(key) == 0;
+      }
+      for (uint64_t key : negative) {
+        nSpurious += rcvdOnly.count(key) == 0;
+      }
+    }
+
+    using ndn::time::duration_cast;
+    using ndn::time::microseconds;
+    std::cout << nDiff << "\t" << nSuccess << "\t" << nFailed << "\t" << nSpurious << "\t"
+              << duration_cast<microseconds>(decodeTime).count() / TRIALS << std::endl;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(PendingDifference)
+{
+  const int N_PUBLISH = 20;
+
+  // A publish changes one key of our IBF, then the differences to the IBFs of the
+  // pending sync interests (which miss a few of our keys) have to be known again
+  std::cout << "cells\tredecode(us)\tincremental(us)" << std::endl;
+  for (size_t expectedNumEntries : {6666, 66666, 666666}) {
+    IBLT ownIBF(expectedNumEntries);
+    for (size_t i = 0; i < expectedNumEntries; i++) {
+      ownIBF.insert(murmurHash3(N_HASHCHECK, i));
+    }
+    IBLT rcvdIBF = ownIBF;
+    for (size_t i = 0; i < 5; i++) {
+      rcvdIBF.erase(murmurHash3(N_HASHCHECK, i));
+    }
+
+    IBLT redecodedIBF = ownIBF;
+    DecodeScratch scratch;
+    std::vector<uint64_t> positive, negative;
+    auto redecodeTime = timedExecute([&] {
+      for (int i = 0; i < N_PUBLISH; i++) {
+        redecodedIBF.insert(murmurHash3(N_HASHCHECK + 1, i));
+        BOOST_CHECK(redecodedIBF.decodeDifference(rcvdIBF, scratch, positive, negative) ==
+                    DecodeResult::SUCCESS);
+      }
+    });
+
+    IbltDifference difference(ownIBF, rcvdIBF);
+    auto incrementalTime = timedExecute([&] {
+      for (int i = 0; i < N_PUBLISH; i++) {
+        ownIBF.insert(murmurHash3(N_HASHCHECK + 1, i));
+        difference.insert(murmurHash3(N_HASHCHECK + 1, i));
+      }
+    });
+    BOOST_CHECK(difference.getResult() == DecodeResult::SUCCESS);
+    BOOST_CHECK_EQUAL(difference.getPositive().size(), positive.size());
+
+    using ndn::time::duration_cast;
+    using ndn::time::microseconds;
+    std::cout << ownIBF.getNumCells() << "\t"
+              << duration_cast<microseconds>(redecodeTime).count() / N_PUBLISH << "\t"
+              << duration_cast<microseconds>(incrementalTime).count() / N_PUBLISH << std::endl;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(ParameterMatrix)
+{
+  const size_t EXPECTED_NUM_ENTRIES = 1000;
+  const int TRIALS = 200;
+
+  // A difference as large as the IBF is sized for, found by one side holding all the keys
+  std::cout << "nHash\tfactor\tcells\tdiff\tsuccess(%)\tdecode(us)" << std::endl;
+  for (uint8_t nHash : {3, 4, 5}) {
+    for (double factor : {1.2, 1.5, 2.0}) {
+      IbltParameters parameters;
+      parameters.nHash = nHash;
+      parameters.overprovisionFactor = factor;
+
+      int nSuccess = 0;
+      ndn::time::nanoseconds decodeTime(0);
+      DecodeScratch scratch;
+      std::vector<uint64_t> positive, negative;
+      for (int trial = 0; trial < TRIALS; trial++) {
+        IBLT ownIBF(EXPECTED_NUM_ENTRIES, CompressionScheme::DEFAULT, KeyWidth::DEFAULT, parameters);
+        IBLT rcvdIBF = ownIBF;
+        for (size_t i = 0; i < EXPECTED_NUM_ENTRIES; i++) {
+          ownIBF.insert(murmurHash3(trial, i));
+        }
+
+        decodeTime += timedExecute([&] {
+          if (ownIBF.decodeDifference(rcvdIBF, scratch, positive, negative) ==
+              DecodeResult::SUCCESS) {
+            ++nSuccess;
+          }
+        });
+      }
+
+      using ndn::time::duration_cast;
+      using ndn::time::microseconds;
+      std::cout << static_cast<int>(nHash) << "\t" << factor << "\t"
+                << IBLT(EXPECTED_NUM_ENTRIES, CompressionScheme::DEFAULT, KeyWidth::DEFAULT,
+                        parameters).getNumCells() << "\t"
+                << EXPECTED_NUM_ENTRIES << "\t" << 100.0 * nSuccess / TRIALS << "\t"
+                << duration_cast<microseconds>(decodeTime).count() / TRIALS << std::endl;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(InsertBatch)
+{
+  std::cout << "keys\tinsert(us)\tinsertBatch(us)" << std::endl;
+  for (size_t nKeys : {10000, 100000, 1000000}) {
+    std::vector<uint64_t> keys;
+    for (size_t i = 0; i < nKeys; i++) {
+      keys.push_back(murmurHash3(N_HASHCHECK, i));
+    }
+
+    IBLT iblt1(nKeys);
+    auto insertTime = timedExecute([&] {
+      for (const auto& key : keys) {
+        iblt1.insert(key);
+      }
+    });
+
+    IBLT iblt2(nKeys);
+    auto batchTime = timedExecute([&] {
+      iblt2.insertBatch(keys);
+    });
+    BOOST_CHECK_EQUAL(iblt1, iblt2);
+
+    using ndn::time::duration_cast;
+    using ndn::time::microseconds;
+    std::cout << nKeys << "\t"
+              << duration_cast<microseconds>(insertTime).count() << "\t"
+              << duration_cast<microseconds>(batchTime).count() << std::endl;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(EraseLocated)
+{
+  const size_t N_KEYS = 100000;
+
+  std::vector<uint64_t> keys;
+  for (size_t i = 0; i < N_KEYS; i++) {
+    keys.push_back(murmurHash3(N_HASHCHECK, i));
+  }
+
+  IBLT iblt1(N_KEYS);
+  IBLT iblt2(N_KEYS);
+  std::vector<IBLT::KeyCells> located;
+  for (const auto& key : keys) {
+    iblt1.insert(key);
+    located.push_back(iblt2.locate(key));
+    iblt2.insert(located.back());
+  }
+
+  // What a publish pays to erase the previous key of its prefix
+  auto eraseTime = timedExecute([&] {
+    for (const auto& key : keys) {
+      iblt1.erase(key);
+    }
+  });
+  auto locatedTime = timedExecute([&] {
+    for (const auto& keyCells : located) {
+      iblt2.erase(keyCells);
+    }
+  });
+  BOOST_CHECK_EQUAL(iblt1, IBLT(N_KEYS));
+  BOOST_CHECK_EQUAL(iblt2, IBLT(N_KEYS));
+
+  using ndn::time::duration_cast;
+  using ndn::time::microseconds;
+  std::cout << "keys\terase(us)\teraseLocated(us)" << std::endl;
+  std::cout << N_KEYS << "\t"
+            << duration_cast<microseconds>(eraseTime).count() << "\t"
+            << duration_cast<microseconds>(locatedTime).count() << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE(Compression)
+{
+  const int REPEAT = 50;
+  const std::vector<std::pair<CompressionScheme, std::string>> schemes = {
+    {CompressionScheme::NONE, "none"},
+    {CompressionScheme::ZLIB, "zlib"},
+    {CompressionScheme::GZIP, "gzip"},
+    {CompressionScheme::BZIP2, "bzip2"},
+    {CompressionScheme::LZMA, "lzma"},
+    {CompressionScheme::ZSTD, "zstd"},
+  };
+
+  std::cout << "scheme\tentries\tbytes\tencode(us)\tdecode(us)" << std::endl;
+  for (size_t expectedNumEntries : {40, 1000, 10000}) {
+    for (const auto& scheme : schemes) {
+      IBLT iblt(expectedNumEntries, scheme.first);
+      for (size_t i = 0; i < expectedNumEntries; i++) {
+        iblt.insert(murmurHash3(N_HASHCHECK, i));
+      }
+
+      ndn::Name name;
+      try {
+        iblt.appendToName(name);
+      }
+      catch (const CompressionError&) {
+        std::cout << scheme.second << "\tnot supported" << std::endl;
+        continue;
+      }
+
+      auto encodeTime = timedExecute([&] {
+        for (int i = 0; i < REPEAT; i++) {
+          // modify the IBLT so that appendToName does not return the cached encoding
+          iblt.insert(0);
+          iblt.erase(0);
+          ndn::Name encoded;
+          iblt.appendToName(encoded);
+        }
+      });
+
+      IBLT rcvd(expectedNumEntries);
+      auto decodeTime = timedExecute([&] {
+        for (int i = 0; i < REPEAT; i++) {
+          rcvd.initialize(name.get(-1));
+        }
+      });
+      BOOST_CHECK_EQUAL(rcvd, iblt);
+
+      using ndn::time::duration_cast;
+      using ndn::time::microseconds;
+      std::cout << scheme.second << "\t" << expectedNumEntries << "\t"
+                << name.get(-1).value_size() << "\t"
+                << duration_cast<microseconds>(encodeTime).count() / REPEAT << "\t"
+                << duration_cast<microseconds>(decodeTime).count() / REPEAT << std::endl;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // namespace tests
+} // namespace psync
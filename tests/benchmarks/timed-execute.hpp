@@ -0,0 +1,41 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014-2019,  The University of Memphis
+ *
+ * This file is part of PSync.
+ * See AUTHORS.md for complete list of PSync authors and contributors.
+ *
+ * PSync is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU Lesser General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * PSync is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along with
+ * PSync, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PSYNC_TESTS_BENCHMARKS_TIMED_EXECUTE_HPP
+#define PSYNC_TESTS_BENCHMARKS_TIMED_EXECUTE_HPP
+
+#include <ndn-cxx/util/time.hpp>
+
+namespace psync {
+namespace tests {
+
+template<typename F>
+ndn::time::nanoseconds
+timedExecute(const F& f)
+{
+  auto before = ndn::time::steady_clock::now();
+  f();
+  auto after = ndn::time::steady_clock::now();
+  return after - before;
+}
+
+} // namespace tests
+} // namespace psync
+
+#endif // PSYNC_TESTS_BENCHMARKS_TIMED_EXECUTE_HPP
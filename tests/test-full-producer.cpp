@@ -51,6 +51,304 @@ BOOST_AUTO_TEST_CASE(OnInterest)
   BOOST_REQUIRE_NO_THROW(node.onSyncInterest(syncPrefix, Interest(syncInterestName)));
 }
 
+BOOST_AUTO_TEST_CASE(OversizedIblt)
+{
+  Name syncPrefix("/psync"), userNode("/testUser");
+  util::DummyClientFace face({true, true});
+
+  FullProducer node(40, face, syncPrefix, userNode, nullptr);
+
+  // Sparse encoding of 60 * 2^26 empty cells, which would fold to our 60 cells
+  std::vector<uint8_t> value{0x10};
+  for (uint64_t nCells = 60ull << 26; ; nCells >>= 7) {
+    value.push_back(static_cast<uint8_t>(nCells >= 0x80 ? (nCells | 0x80) : nCells));
+    if (nCells < 0x80) {
+      break;
+    }
+  }
+  Name syncInterestName(syncPrefix);
+  syncInterestName.append(name::Component(value.begin(), value.end()));
+
+  // Rejected without being answered or kept
+  BOOST_REQUIRE_NO_THROW(node.onSyncInterest(syncPrefix, Interest(syncInterestName)));
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_CHECK(face.sentData.empty());
+  // so publishing does not answer it either
+  node.publishName(userNode);
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_CHECK(face.sentData.empty());
+}
+
+BOOST_AUTO_TEST_CASE(StrataEstimator)
+{
+  Name syncPrefix("/psync"), userNode("/testUser");
+  util::DummyClientFace face({true, true});
+
+  FullProducer::Options options;
+  options.useStrataEstimator = true;
+  FullProducer node(40, face, syncPrefix, userNode, nullptr, SYNC_INTEREST_LIFTIME,
+                    SYNC_REPLY_FRESHNESS, options);
+  // Only kept by producers that use it
+  FullProducer noEstimator(40, face, syncPrefix, userNode, nullptr);
+  BOOST_CHECK(!noEstimator.m_strataEstimator);
+
+  psync::StrataEstimator expected;
+  for (int i = 0; i < 30; i++) {
+    Name prefix(userNode);
+    prefix.appendNumber(i);
+    node.addUserNode(prefix);
+    node.publishName(prefix);
+    expected.insert(node.m_prefix2hash[Name(prefix).appendNumber(1)]);
+  }
+  BOOST_REQUIRE(node.m_strataEstimator);
+  BOOST_CHECK_EQUAL(node.m_strataEstimator->estimateDifference(expected), 0);
+
+  // Sync interest carries IBF and strata estimator
+  node.sendSyncInterest();
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_REQUIRE(!face.sentInterests.empty());
+  BOOST_CHECK_EQUAL(face.sentInterests.back().getName().size(), syncPrefix.size() + 3);
+
+  // Difference to an empty peer is estimated above threshold, all state is sent
+  IBLT emptyIBF(40);
+  psync::StrataEstimator emptyEstimator;
+  Name syncInterestName(syncPrefix);
+  emptyIBF.appendToName(syncInterestName);
+  syncInterestName.append("estimator");
+  emptyEstimator.appendToName(syncInterestName);
+  face.sentData.clear();
+  node.onSyncInterest(syncPrefix, Interest(syncInterestName));
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_CHECK_EQUAL(face.sentData.size(), 1);
+
+  syncInterestName = Name(syncPrefix);
+  emptyIBF.appendToName(syncInterestName);
+  syncInterestName.append("estimator").append("malicious-estimator");
+  BOOST_REQUIRE_NO_THROW(node.onSyncInterest(syncPrefix, Interest(syncInterestName)));
+
+  // An interest for a segment of sync data that is not in our store is no sync interest,
+  // its last IBF component is not a strata estimator
+  syncInterestName = Name(syncPrefix);
+  emptyIBF.appendToName(syncInterestName);
+  syncInterestName.appendNumber(12345).appendVersion().appendSegment(1);
+  face.sentData.clear();
+  node.onSyncInterest(syncPrefix, Interest(syncInterestName));
+  noEstimator.onSyncInterest(syncPrefix, Interest(syncInterestName));
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_CHECK(face.sentData.empty());
+}
+
+BOOST_AUTO_TEST_CASE(RatelessIblt)
+{
+  Name syncPrefix("/psync"), userNode("/testUser");
+  util::DummyClientFace face({true, true});
+
+  FullProducer::Options options;
+  options.useRatelessIblt = true;
+  FullProducer node(40, face, syncPrefix, userNode, nullptr, SYNC_INTEREST_LIFTIME,
+                    SYNC_REPLY_FRESHNESS, options);
+  for (int i = 0; i < 10; i++) {
+    node.publishName(userNode);
+  }
+
+  // Sync interest carries the digest of the IBF only
+  node.sendSyncInterest();
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_REQUIRE(!face.sentInterests.empty());
+  Name syncInterestName = face.sentInterests.back().getName();
+  BOOST_REQUIRE_EQUAL(syncInterestName.size(), syncPrefix.size() + 2);
+  BOOST_CHECK_EQUAL(syncInterestName.get(-1).toNumber(), node.m_iblt.getDigest());
+
+  // Coded symbols are published for the current IBF only, others get a Nack
+  face.sentData.clear();
+  node.onSyncInterest(syncPrefix, Interest(Name(syncPrefix).append("symbols").appendNumber(1)));
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_REQUIRE_EQUAL(face.sentData.size(), 1);
+  BOOST_CHECK_EQUAL(face.sentData.back().getContentType(), ndn::tlv::ContentType_Nack);
+
+  face.sentData.clear();
+  node.onSyncInterest(syncPrefix, Interest(Name(syncPrefix).append("symbols")
+                                             .appendNumber(node.m_iblt.getDigest())));
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_REQUIRE_EQUAL(face.sentData.size(), 1);
+
+  // An empty peer decodes our set from them
+  RatelessDecoder decoder((RatelessEncoder()));
+  const Block& content = face.sentData.back().getContent();
+  decoder.addEncodedBytes(content.value(), content.value() + content.value_size());
+  BOOST_CHECK(decoder.isDecoded());
+  BOOST_CHECK_EQUAL(decoder.getRemoteOnly().size(), node.m_hash2prefix.size());
+
+  // The encoder is kept from then on and follows our updates
+  BOOST_REQUIRE(node.m_ratelessEncoder);
+  node.publishName(userNode);
+  face.sentData.clear();
+  node.onSyncInterest(syncPrefix, Interest(Name(syncPrefix).append("symbols")
+                                             .appendNumber(node.m_iblt.getDigest())));
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_REQUIRE_EQUAL(face.sentData.size(), 1);
+  RatelessDecoder updatedDecoder((RatelessEncoder()));
+  const Block& updatedContent = face.sentData.back().getContent();
+  updatedDecoder.addEncodedBytes(updatedContent.value(),
+                                 updatedContent.value() + updatedContent.value_size());
+  BOOST_REQUIRE(updatedDecoder.isDecoded());
+  BOOST_REQUIRE_EQUAL(updatedDecoder.getRemoteOnly().size(), 1);
+  BOOST_CHECK_EQUAL(*updatedDecoder.getRemoteOnly().begin(),
+                    node.m_prefix2hash[Name(userNode).appendNumber(11)]);
+}
+
+BOOST_AUTO_TEST_CASE(SameIbltDigest)
+{
+  Name syncPrefix("/psync"), userNode("/testUser");
+  util::DummyClientFace face({true, true});
+
+  FullProducer node(40, face, syncPrefix, userNode, nullptr);
+  node.publishName(userNode);
+
+  // An IBF equal to ours is kept pending without being decoded
+  Name syncInterestName(syncPrefix);
+  node.m_iblt.appendToName(syncInterestName);
+  face.sentData.clear();
+  node.onSyncInterest(syncPrefix, Interest(syncInterestName));
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_CHECK(face.sentData.empty());
+
+  // and answered on the next update
+  node.publishName(userNode);
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_CHECK_EQUAL(face.sentData.size(), 1);
+
+  // A table that only claims our digest is decoded, and answered with what it lacks
+  IBLT empty(40);
+  std::vector<uint8_t> value(empty.getEncoded().value_begin(), empty.getEncoded().value_end());
+  std::copy(node.m_iblt.getEncoded().value_begin() + 1,
+            node.m_iblt.getEncoded().value_begin() + 9, value.begin() + 1);
+  name::Component liarName(value.begin(), value.end());
+  BOOST_REQUIRE(IBLT::extractDigest(liarName) == node.m_iblt.getDigest());
+  face.sentData.clear();
+  node.onSyncInterest(syncPrefix, Interest(Name(syncPrefix).append(liarName)));
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_CHECK_EQUAL(face.sentData.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(IbltDigestReference)
+{
+  Name syncPrefix("/psync"), userNode("/testUser");
+  util::DummyClientFace face({true, true});
+
+  FullProducer::Options options;
+  options.useIbltDigest = true;
+  FullProducer node(40, face, syncPrefix, userNode, nullptr, SYNC_INTEREST_LIFTIME,
+                    SYNC_REPLY_FRESHNESS, options);
+  node.publishName(userNode);
+  IBLT old = node.m_iblt;
+  node.publishName(userNode);
+  node.publishName(userNode);
+
+  // Our recent IBFs are rebuilt from their digests
+  BOOST_REQUIRE(node.getIbltFromHistory(old.getDigest()));
+  BOOST_CHECK_EQUAL(*node.getIbltFromHistory(old.getDigest()), old);
+  BOOST_CHECK(!node.getIbltFromHistory(IBLT(40).getDigest() + 1));
+
+  // Sync interests carry only the digest of our IBF
+  node.sendSyncInterest();
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_REQUIRE(!face.sentInterests.empty());
+  name::Component ibltName = face.sentInterests.back().getName().get(syncPrefix.size());
+  BOOST_CHECK(ibltName == IBLT::makeDigestReference(node.m_iblt.getDigest()));
+
+  // A reference to an old IBF of ours is answered with the updates since
+  Name syncInterestName(syncPrefix);
+  syncInterestName.append(IBLT::makeDigestReference(old.getDigest()));
+  face.sentData.clear();
+  node.onSyncInterest(syncPrefix, Interest(syncInterestName));
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_REQUIRE_EQUAL(face.sentData.size(), 1);
+  BOOST_CHECK_NE(face.sentData.back().getContentType(), ndn::tlv::ContentType_Nack);
+
+  // and a reference to an unknown IBF with a Nack
+  syncInterestName = Name(syncPrefix).append(IBLT::makeDigestReference(12345));
+  face.sentData.clear();
+  node.onSyncInterest(syncPrefix, Interest(syncInterestName));
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_REQUIRE_EQUAL(face.sentData.size(), 1);
+  BOOST_CHECK_EQUAL(face.sentData.back().getContentType(), ndn::tlv::ContentType_Nack);
+}
+
+BOOST_AUTO_TEST_CASE(DecodeCache)
+{
+  Name syncPrefix("/psync"), userNode("/testUser");
+  util::DummyClientFace face({true, true});
+
+  FullProducer node(40, face, syncPrefix, userNode, nullptr);
+  node.publishName(userNode);
+
+  // Others ahead of us by one key, their interests are kept pending
+  IBLT other = node.m_iblt;
+  other.insert(12345);
+  Name syncInterestName(syncPrefix);
+  other.appendToName(syncInterestName);
+
+  // The same IBF from others is decoded once
+  node.onSyncInterest(syncPrefix, Interest(syncInterestName));
+  node.onSyncInterest(syncPrefix, Interest(syncInterestName));
+  BOOST_CHECK_EQUAL(node.getNDecodeCacheMisses(), 1);
+  BOOST_CHECK_EQUAL(node.getNDecodeCacheHits(), 1);
+  // and its difference is counted once
+  BOOST_CHECK(node.getDifferenceSizes() == (DifferenceSizeHistogram{{1, 1}}));
+
+  // until our IBF changes
+  node.publishName(userNode);
+  other = node.m_iblt;
+  other.insert(12345);
+  syncInterestName = Name(syncPrefix);
+  other.appendToName(syncInterestName);
+
+  // A table that claims the digest of another is not cached for those who send that one
+  IBLT liar = node.m_iblt;
+  liar.insert(54321);
+  std::vector<uint8_t> value(liar.getEncoded().value_begin(), liar.getEncoded().value_end());
+  std::copy(other.getEncoded().value_begin() + 1, other.getEncoded().value_begin() + 9,
+            value.begin() + 1);
+  name::Component liarName(value.begin(), value.end());
+  BOOST_REQUIRE(IBLT::extractDigest(liarName) == other.getDigest());
+  node.onSyncInterest(syncPrefix, Interest(Name(syncPrefix).append(liarName)));
+  BOOST_CHECK_EQUAL(node.getNDecodeCacheMisses(), 2);
+
+  node.onSyncInterest(syncPrefix, Interest(syncInterestName));
+  BOOST_CHECK_EQUAL(node.getNDecodeCacheMisses(), 3);
+  BOOST_CHECK_EQUAL(node.getNDecodeCacheHits(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(FoldedIblt)
+{
+  Name syncPrefix("/psync"), userNode("/testUser");
+  util::DummyClientFace face({true, true});
+
+  FullProducer::Options options;
+  options.foldIblt = true;
+  FullProducer node(40, face, syncPrefix, userNode, nullptr, SYNC_INTEREST_LIFTIME,
+                    SYNC_REPLY_FRESHNESS, options);
+
+  // No updates yet, the IBF is folded from 60 to 15 cells
+  node.sendSyncInterest();
+  face.processEvents(ndn::time::milliseconds(10));
+  BOOST_REQUIRE(!face.sentInterests.empty());
+  IBLT rcvd(40);
+  rcvd.initialize(face.sentInterests.back().getName().get(syncPrefix.size()));
+  BOOST_CHECK_EQUAL(rcvd.getNumCells(), 15);
+  BOOST_CHECK_EQUAL(rcvd, node.m_iblt.fold(4));
+
+  // Many updates, the IBF is sent in full
+  for (int i = 0; i < 20; i++) {
+    node.publishName(userNode);
+  }
+  node.sendSyncInterest();
+  face.processEvents(ndn::time::milliseconds(10));
+  rcvd.initialize(face.sentInterests.back().getName().get(syncPrefix.size()));
+  BOOST_CHECK_EQUAL(rcvd, node.m_iblt);
+}
+
 BOOST_FIXTURE_TEST_CASE(ConstantTimeoutForFirstSegment, ndn::tests::UnitTestTimeFixture)
 {
   Name syncPrefix("/psync"), userNode("/testUser");
@@ -112,6 +112,36 @@ BOOST_AUTO_TEST_CASE(SameSyncInterest)
   BOOST_CHECK_EQUAL(producer.m_pendingEntries.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(SameIbltDigestReference)
+{
+  Name syncPrefix("/psync"), userNode("/testUser");
+  util::DummyClientFace face({true, true});
+  PartialProducer producer(40, face, syncPrefix, userNode);
+  producer.publishName(userNode);
+
+  // A reference to our current IBF is kept pending without being decoded
+  Name syncInterestName(syncPrefix);
+  syncInterestName.append("sync");
+  Name syncInterestPrefix = syncInterestName;
+  BloomFilter bf(20, 0.001);
+  bf.insert(userNode.toUri());
+  bf.appendToName(syncInterestName);
+  syncInterestName.append(IBLT::makeDigestReference(producer.m_iblt.getDigest()));
+
+  face.sentData.clear();
+  BOOST_REQUIRE_NO_THROW(producer.onSyncInterest(syncInterestPrefix, Interest(syncInterestName)));
+  face.processEvents(time::milliseconds(10));
+  BOOST_CHECK(face.sentData.empty());
+  BOOST_CHECK_EQUAL(producer.getNDecodeCacheMisses(), 0);
+  BOOST_CHECK_EQUAL(producer.m_pendingEntries.size(), 1);
+
+  // and answered on the next update
+  producer.publishName(userNode);
+  face.processEvents(time::milliseconds(10));
+  BOOST_CHECK_EQUAL(face.sentData.size(), 1);
+  BOOST_CHECK_EQUAL(producer.m_pendingEntries.size(), 0);
+}
+
 BOOST_AUTO_TEST_CASE(OnSyncInterest)
 {
   Name syncPrefix("/psync"), userNode("/testUser");
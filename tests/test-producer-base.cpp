@@ -51,7 +51,7 @@ BOOST_AUTO_TEST_CASE(Basic)
   BOOST_CHECK(producerBase.getSeqNo(userNode.toUri()).value() == 1);
 
   std::string prefixWithSeq = Name(userNode).appendNumber(1).toUri();
-  uint32_t hash = producerBase.m_prefix2hash[prefixWithSeq];
+  uint64_t hash = producerBase.m_prefix2hash[prefixWithSeq];
   BOOST_CHECK_EQUAL(producerBase.m_hash2prefix[hash], userNode.toUri());
 
   producerBase.removeUserNode(userNode);
@@ -65,6 +65,157 @@ BOOST_AUTO_TEST_CASE(Basic)
               producerBase.m_prefix2hash.end());
 }
 
+BOOST_AUTO_TEST_CASE(KeyWidth64)
+{
+  util::DummyClientFace face;
+  Name userNode("/testUser");
+  ProducerBase producerBase(40, face, Name("/psync"), userNode, SYNC_REPLY_FRESHNESS,
+                            HELLO_REPLY_FRESHNESS, CompressionScheme::DEFAULT, KeyWidth::BITS_64);
+  BOOST_CHECK(producerBase.m_iblt.getKeyWidth() == KeyWidth::BITS_64);
+
+  producerBase.updateSeqNo(userNode, 1);
+  Name prefixWithSeq = Name(userNode).appendNumber(1);
+  uint64_t hash = producerBase.m_prefix2hash[prefixWithSeq];
+  BOOST_CHECK_EQUAL(hash, murmurHash3x64(N_HASHCHECK, prefixWithSeq.toUri()));
+
+  IBLT expected(40, CompressionScheme::DEFAULT, KeyWidth::BITS_64);
+  expected.insert(hash);
+  BOOST_CHECK_EQUAL(producerBase.m_iblt, expected);
+}
+
+BOOST_AUTO_TEST_CASE(BatchUpdate)
+{
+  util::DummyClientFace face;
+  ProducerBase producer1(40, face, Name("/psync"), Name("/testUser0"));
+  ProducerBase producer2(40, face, Name("/psync"), Name("/testUser0"));
+
+  std::vector<std::pair<Name, uint64_t>> updates;
+  for (int i = 0; i < 10; i++) {
+    Name prefix("/testUser" + std::to_string(i));
+    producer1.addUserNode(prefix);
+    producer2.addUserNode(prefix);
+    updates.emplace_back(prefix, 1);
+    updates.emplace_back(prefix, i + 2);
+  }
+  // Ignored just like with updateSeqNo(prefix, seq)
+  updates.emplace_back("/testUser0", 1);
+  updates.emplace_back("/notAUser", 1);
+
+  for (const auto& update : updates) {
+    producer1.updateSeqNo(update.first, update.second);
+  }
+  producer2.updateSeqNo(updates);
+
+  BOOST_CHECK_EQUAL(producer1.m_iblt, producer2.m_iblt);
+  BOOST_REQUIRE_EQUAL(producer1.m_prefixes.size(), producer2.m_prefixes.size());
+  for (const auto& prefix : producer1.m_prefixes) {
+    const auto& other = producer2.m_prefixes.at(prefix.first);
+    BOOST_CHECK_EQUAL(prefix.second.seq, other.seq);
+    BOOST_REQUIRE_EQUAL(static_cast<bool>(prefix.second.keyCells),
+                        static_cast<bool>(other.keyCells));
+    if (prefix.second.keyCells) {
+      BOOST_CHECK_EQUAL(prefix.second.keyCells->key, other.keyCells->key);
+    }
+  }
+  BOOST_CHECK(producer1.m_prefix2hash == producer2.m_prefix2hash);
+  BOOST_CHECK(producer1.m_hash2prefix == producer2.m_hash2prefix);
+}
+
+BOOST_AUTO_TEST_CASE(BatchUpdateDuplicatePrefix)
+{
+  util::DummyClientFace face;
+  Name userNode("/testUser");
+  ProducerBase producer(40, face, Name("/psync"), userNode);
+
+  producer.updateSeqNo(userNode, 1);
+  producer.updateSeqNo({{userNode, 2}, {userNode, 3}, {userNode, 4}});
+
+  // Only the hash of the last seq is in the IBF, with its cells kept
+  uint64_t hash = producer.m_prefix2hash[Name(userNode).appendNumber(4)];
+  IBLT expected(40);
+  expected.insert(hash);
+  BOOST_CHECK_EQUAL(producer.m_iblt, expected);
+  BOOST_CHECK_EQUAL(producer.m_prefix2hash.size(), 1);
+  BOOST_CHECK_EQUAL(producer.m_hash2prefix.size(), 1);
+  const auto& keyCells = producer.m_prefixes.at(userNode).keyCells;
+  BOOST_REQUIRE(keyCells);
+  BOOST_CHECK_EQUAL(keyCells->key, hash);
+
+  // And erasing it leaves nothing behind
+  producer.removeUserNode(userNode);
+  BOOST_CHECK_EQUAL(producer.m_iblt, IBLT(40));
+  BOOST_CHECK(producer.m_prefixes.empty());
+}
+
+BOOST_AUTO_TEST_CASE(PickExpectedNumEntries)
+{
+  BOOST_CHECK_EQUAL(ProducerBase::pickExpectedNumEntries({}, 40), 40);
+
+  // Small differences still get a table that decodes its threshold reliably
+  BOOST_CHECK_EQUAL(ProducerBase::pickExpectedNumEntries({{1, 100}, {3, 10}}, 40), 64);
+
+  // 99% of the differences are up to 100 entries, 1% are far larger
+  DifferenceSizeHistogram histogram{{10, 500}, {100, 490}, {5000, 10}};
+  BOOST_CHECK_EQUAL(ProducerBase::pickExpectedNumEntries(histogram, 40), 256);
+  BOOST_CHECK_EQUAL(ProducerBase::pickExpectedNumEntries(histogram, 40, 0.5), 64);
+  BOOST_CHECK_EQUAL(ProducerBase::pickExpectedNumEntries(histogram, 40, 1.0), 16384);
+
+  // Decoded differences are counted
+  util::DummyClientFace face;
+  ProducerBase producerBase(40, face, Name("/psync"), Name("/testUser"));
+  IBLT other(40);
+  other.insert(1);
+  other.insert(2);
+  std::vector<uint64_t> positive, negative;
+  producerBase.decodeDifference(other, positive, negative);
+  BOOST_CHECK(producerBase.getDifferenceSizes() == (DifferenceSizeHistogram{{2, 1}}));
+}
+
+BOOST_AUTO_TEST_CASE(AutoSizing)
+{
+  util::DummyClientFace face;
+  Name userNode("/testUser");
+  ProducerBase producerBase(160, face, Name("/psync"), userNode);
+  producerBase.updateSeqNo(userNode, 1);
+  uint64_t digest = producerBase.m_iblt.getDigest();
+  producerBase.setAutoSizing(2);
+
+  IBLT small(160);
+  small.insert(1);
+  small.insert(2);
+  std::vector<uint64_t> positive, negative;
+  producerBase.decodeDifference(small, positive, negative);
+  producerBase.decodeDifference(small, positive, negative);
+  BOOST_CHECK_EQUAL(producerBase.m_expectedNumEntries, 160);
+
+  // The period is over: small differences shrink the IBF before the next decode,
+  // to the smallest size that folds to the constructed one and reaches 64
+  BOOST_CHECK(producerBase.decodeDifference(small, positive, negative) ==
+              DecodeResult::SUCCESS);
+  BOOST_CHECK_EQUAL(positive.size(), 1);
+  BOOST_CHECK_EQUAL(negative.size(), 2);
+  BOOST_CHECK_EQUAL(producerBase.m_expectedNumEntries, 80);
+  BOOST_CHECK_EQUAL(producerBase.m_threshold, 40);
+  BOOST_CHECK_EQUAL(producerBase.m_iblt.getNumCells(), 120);
+  BOOST_CHECK_EQUAL(producerBase.m_iblt.getDigest(), digest);
+
+  // The cells of the key were located again: erasing it leaves the new table empty
+  producerBase.updateSeqNo(userNode, 2);
+  IBLT expected(80);
+  expected.insert(producerBase.m_prefix2hash[Name(userNode).appendNumber(2)]);
+  BOOST_CHECK(producerBase.m_iblt == expected);
+
+  // Differences that do not decode count as threshold and grow the IBF again
+  IBLT large(160);
+  for (uint64_t key = 1; key <= 200; ++key) {
+    large.insert(key);
+  }
+  producerBase.decodeDifference(large, positive, negative);
+  producerBase.decodeDifference(large, positive, negative);
+  producerBase.decodeDifference(large, positive, negative);
+  BOOST_CHECK_EQUAL(producerBase.m_expectedNumEntries, 160);
+}
+
 BOOST_AUTO_TEST_CASE(ApplicationNack)
 {
   util::DummyClientFace face;
@@ -0,0 +1,216 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014-2019,  The University of Memphis
+ *
+ * This file is part of PSync.
+ * See AUTHORS.md for complete list of PSync authors and contributors.
+ *
+ * PSync is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU Lesser General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * PSync is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along with
+ * PSync, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "PSync/detail/rateless-iblt.hpp"
+#include "PSync/detail/util.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <ndn-cxx/name.hpp>
+
+namespace psync {
+
+using namespace ndn;
+
+BOOST_AUTO_TEST_SUITE(TestRatelessIblt)
+
+static uint64_t
+getKey(int i, KeyWidth keyWidth = KeyWidth::DEFAULT)
+{
+  std::string uri = Name("/test/memphis").appendNumber(i).toUri();
+  return keyWidth == KeyWidth::BITS_32 ? murmurHash3(N_HASHCHECK, uri) :
+                                         murmurHash3x64(N_HASHCHECK, uri);
+}
+
+BOOST_AUTO_TEST_CASE(SymbolMappingDensity)
+{
+  // Every key is in the first symbol, and in about 1/(1 + i/2) of the symbols around i
+  size_t nInFirst = 0;
+  size_t nAround100 = 0;
+  for (int i = 0; i < 1000; i++) {
+    SymbolMapping mapping(getKey(i), KeyWidth::DEFAULT);
+    if (mapping.getIndex() == 0) {
+      ++nInFirst;
+    }
+    for (; mapping.getIndex() < 110; mapping.next()) {
+      if (mapping.getIndex() >= 90) {
+        ++nAround100;
+      }
+    }
+  }
+  BOOST_CHECK_EQUAL(nInFirst, 1000);
+  // 1000 keys * 20 symbols / 51
+  BOOST_CHECK_GE(nAround100, 300);
+  BOOST_CHECK_LE(nAround100, 500);
+}
+
+BOOST_AUTO_TEST_CASE(Decode)
+{
+  RatelessEncoder local, remote;
+  for (int i = 0; i < 1000; i++) {
+    local.insert(getKey(i));
+    remote.insert(getKey(i));
+  }
+  for (int i = 1000; i < 1030; i++) {
+    local.insert(getKey(i));
+  }
+  for (int i = 2000; i < 2070; i++) {
+    remote.insert(getKey(i));
+  }
+
+  RatelessDecoder decoder(local);
+  std::vector<HashTableEntry> symbols = remote.getSymbols(1000);
+  for (const auto& symbol : symbols) {
+    decoder.addSymbol(symbol);
+    if (decoder.isDecoded()) {
+      break;
+    }
+  }
+
+  BOOST_REQUIRE(decoder.isDecoded());
+  // 100 differences take well under three symbols each
+  BOOST_CHECK_LE(decoder.getNumSymbols(), 300);
+  BOOST_CHECK_EQUAL(decoder.getRemoteOnly().size(), 70);
+  BOOST_CHECK_EQUAL(decoder.getLocalOnly().size(), 30);
+  BOOST_CHECK_EQUAL(decoder.getRemoteOnly().count(getKey(2000)), 1);
+  BOOST_CHECK_EQUAL(decoder.getLocalOnly().count(getKey(1000)), 1);
+
+  // Equal sets decode from the first symbol
+  RatelessDecoder sameDecoder(local);
+  sameDecoder.addSymbol(local.getSymbols(1).front());
+  BOOST_CHECK(sameDecoder.isDecoded());
+  BOOST_CHECK(sameDecoder.getRemoteOnly().empty());
+}
+
+BOOST_AUTO_TEST_CASE(FalsePureSymbol)
+{
+  // A key that is not mapped to coded symbol 1
+  int i = 0;
+  SymbolMapping mapping(getKey(i), KeyWidth::DEFAULT);
+  for (mapping.next(); mapping.getIndex() == 1; mapping.next()) {
+    mapping = SymbolMapping(getKey(++i), KeyWidth::DEFAULT);
+  }
+  uint64_t key = getKey(i);
+
+  // Coded symbol 1 passes the check with that key, as a sum of several keys could by chance,
+  // but is not peeled
+  RatelessDecoder decoder((RatelessEncoder()));
+  decoder.addSymbol(HashTableEntry{0, 0, 0});
+  decoder.addSymbol(HashTableEntry{1, key, hashKey(N_HASHCHECK, key, KeyWidth::DEFAULT)});
+  BOOST_CHECK(decoder.getRemoteOnly().empty());
+  BOOST_CHECK(decoder.isDecoded());
+}
+
+BOOST_AUTO_TEST_CASE(CachedSymbols)
+{
+  RatelessEncoder cached(KeyWidth::DEFAULT, 50), uncached;
+  for (int i = 0; i < 200; i++) {
+    cached.insert(getKey(i));
+    uncached.insert(getKey(i));
+  }
+  for (int i = 0; i < 200; i += 2) {
+    cached.erase(getKey(i));
+    uncached.erase(getKey(i));
+  }
+  // Inserting a key twice or erasing a missing one changes nothing
+  cached.insert(getKey(1));
+  cached.erase(getKey(0));
+
+  std::vector<HashTableEntry> cachedSymbols = cached.getSymbols(50);
+  std::vector<HashTableEntry> symbols = uncached.getSymbols(50);
+  for (size_t i = 0; i < symbols.size(); i++) {
+    BOOST_CHECK_EQUAL(cachedSymbols[i].count, symbols[i].count);
+    BOOST_CHECK_EQUAL(cachedSymbols[i].keySum, symbols[i].keySum);
+    BOOST_CHECK_EQUAL(cachedSymbols[i].keyCheck, symbols[i].keyCheck);
+  }
+  BOOST_CHECK_EQUAL(cached.getSymbols(100).back().keySum, uncached.getSymbols(100).back().keySum);
+
+  // A decoder against a few cached symbols goes on with the local keys after them
+  RatelessEncoder local(KeyWidth::DEFAULT, 5), remote;
+  for (int i = 0; i < 1000; i++) {
+    local.insert(getKey(i));
+    remote.insert(getKey(i));
+  }
+  for (int i = 1000; i < 1040; i++) {
+    remote.insert(getKey(i));
+  }
+  RatelessDecoder decoder(local);
+  for (const auto& symbol : remote.getSymbols(1000)) {
+    decoder.addSymbol(symbol);
+    if (decoder.isDecoded()) {
+      break;
+    }
+  }
+  BOOST_REQUIRE(decoder.isDecoded());
+  BOOST_CHECK_GT(decoder.getNumSymbols(), 5);
+  BOOST_CHECK_EQUAL(decoder.getRemoteOnly().size(), 40);
+  BOOST_CHECK(decoder.getLocalOnly().empty());
+
+  // A decoder keeps the local set it was made from, even if the encoder changes after
+  RatelessDecoder before(local);
+  for (int i = 1000; i < 1010; i++) {
+    local.insert(getKey(i));
+  }
+  RatelessDecoder after(local);
+  for (const auto& symbol : remote.getSymbols(1000)) {
+    if (!before.isDecoded()) {
+      before.addSymbol(symbol);
+    }
+    if (!after.isDecoded()) {
+      after.addSymbol(symbol);
+    }
+  }
+  BOOST_REQUIRE(before.isDecoded());
+  BOOST_REQUIRE(after.isDecoded());
+  BOOST_CHECK_EQUAL(before.getRemoteOnly().size(), 40);
+  BOOST_CHECK_EQUAL(after.getRemoteOnly().size(), 30);
+}
+
+BOOST_AUTO_TEST_CASE(DecodeEncodedBytes)
+{
+  for (KeyWidth keyWidth : {KeyWidth::BITS_32, KeyWidth::BITS_64}) {
+    RatelessEncoder local(keyWidth), remote(keyWidth);
+    for (int i = 0; i < 100; i++) {
+      local.insert(getKey(i, keyWidth));
+      remote.insert(getKey(i, keyWidth));
+    }
+    for (int i = 100; i < 110; i++) {
+      remote.insert(getKey(i, keyWidth));
+    }
+
+    Block wire = remote.wireEncode(100);
+    RatelessDecoder decoder(local);
+    // Parts that split the header and the symbols
+    for (size_t i = 0; i < wire.size() && !decoder.isDecoded(); i += 7) {
+      decoder.addEncodedBytes(wire.wire() + i, wire.wire() + std::min(i + 7, wire.size()));
+    }
+    BOOST_REQUIRE(decoder.isDecoded());
+    BOOST_CHECK_EQUAL(decoder.getRemoteOnly().size(), 10);
+    BOOST_CHECK(decoder.getLocalOnly().empty());
+  }
+
+  RatelessEncoder encoder64(KeyWidth::BITS_64);
+  Block wire = encoder64.wireEncode(10);
+  RatelessDecoder decoder32((RatelessEncoder()));
+  BOOST_CHECK_THROW(decoder32.addEncodedBytes(wire.wire(), wire.wire() + wire.size()),
+                    RatelessDecoder::Error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // namespace psync
@@ -0,0 +1,88 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014-2019,  The University of Memphis
+ *
+ * This file is part of PSync.
+ * See AUTHORS.md for complete list of PSync authors and contributors.
+ *
+ * PSync is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU Lesser General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * PSync is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along with
+ * PSync, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "PSync/detail/strata-estimator.hpp"
+#include "PSync/detail/util.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <ndn-cxx/name.hpp>
+
+namespace psync {
+
+using namespace ndn;
+
+BOOST_AUTO_TEST_SUITE(TestStrataEstimator)
+
+BOOST_AUTO_TEST_CASE(Estimate)
+{
+  StrataEstimator se1, se2;
+  for (int i = 0; i < 1000; i++) {
+    uint32_t hash = murmurHash3(N_HASHCHECK, Name("/test/memphis").appendNumber(i).toUri());
+    se1.insert(hash);
+    se2.insert(hash);
+  }
+  BOOST_CHECK_EQUAL(se1.estimateDifference(se2), 0);
+
+  // Small differences are decoded exactly
+  for (int i = 1000; i < 1005; i++) {
+    se1.insert(murmurHash3(N_HASHCHECK, Name("/test/memphis").appendNumber(i).toUri()));
+  }
+  BOOST_CHECK_EQUAL(se1.estimateDifference(se2), 5);
+  BOOST_CHECK_EQUAL(se2.estimateDifference(se1), 5);
+
+  // Large differences are estimated within a factor of two
+  for (int i = 1005; i < 3000; i++) {
+    se1.insert(murmurHash3(N_HASHCHECK, Name("/test/memphis").appendNumber(i).toUri()));
+  }
+  size_t estimate = se1.estimateDifference(se2);
+  BOOST_CHECK_GE(estimate, 1000);
+  BOOST_CHECK_LE(estimate, 4000);
+
+  for (int i = 1000; i < 3000; i++) {
+    se1.erase(murmurHash3(N_HASHCHECK, Name("/test/memphis").appendNumber(i).toUri()));
+  }
+  BOOST_CHECK_EQUAL(se1.estimateDifference(se2), 0);
+}
+
+BOOST_AUTO_TEST_CASE(NameAppendAndExtract)
+{
+  StrataEstimator se;
+  for (int i = 0; i < 100; i++) {
+    se.insert(murmurHash3(N_HASHCHECK, Name("/test/memphis").appendNumber(i).toUri()));
+  }
+
+  Name name("sync");
+  se.appendToName(name);
+
+  StrataEstimator rcvd;
+  rcvd.initialize(name.get(-1));
+  BOOST_CHECK_EQUAL(rcvd.estimateDifference(se), 0);
+
+  std::vector<uint8_t> value(name.get(-1).value_begin(), name.get(-1).value_end());
+  value.pop_back();
+  BOOST_CHECK_THROW(rcvd.initialize(name::Component(value.begin(), value.end())),
+                    StrataEstimator::Error);
+  BOOST_CHECK_THROW(rcvd.initialize(name::Component()), StrataEstimator::Error);
+  // A failed initialize leaves the estimator unchanged
+  BOOST_CHECK_EQUAL(rcvd.estimateDifference(se), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // namespace psync
@@ -0,0 +1,205 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014-2019,  The University of Memphis
+ *
+ * This file is part of PSync.
+ * See AUTHORS.md for complete list of PSync authors and contributors.
+ *
+ * PSync is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU Lesser General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * PSync is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along with
+ * PSync, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "PSync/detail/util.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+namespace psync {
+
+BOOST_AUTO_TEST_SUITE(TestUtil)
+
+BOOST_AUTO_TEST_CASE(MurmurHash3)
+{
+  // Reference values of MurmurHash3_x86_32
+  BOOST_CHECK_EQUAL(murmurHash3(0, std::string()), 0);
+  BOOST_CHECK_EQUAL(murmurHash3(1, std::string()), 0x514e28b7);
+  BOOST_CHECK_EQUAL(murmurHash3(0, std::string("The quick brown fox jumps over the lazy dog")),
+                    0x2e4ff723);
+  BOOST_CHECK_EQUAL(murmurHash3(0x9747b28c, std::string("Hello, world!")), 0x24884cba);
+
+  // All overloads hash the same bytes the same way, whatever their alignment
+  std::vector<unsigned char> bytes(40);
+  for (size_t i = 0; i < bytes.size(); i++) {
+    bytes[i] = static_cast<unsigned char>(i * 37 + 1);
+  }
+  for (size_t offset = 0; offset < 4; offset++) {
+    for (size_t size = 0; offset + size <= bytes.size(); size++) {
+      std::vector<unsigned char> part(bytes.begin() + offset, bytes.begin() + offset + size);
+      std::string str(part.begin(), part.end());
+      BOOST_CHECK_EQUAL(murmurHash3(11, bytes.data() + offset, size), murmurHash3(11, part));
+      BOOST_CHECK_EQUAL(murmurHash3(11, str), murmurHash3(11, part));
+      BOOST_CHECK_EQUAL(murmurHash3x64(11, bytes.data() + offset, size), murmurHash3x64(11, part));
+      BOOST_CHECK_EQUAL(murmurHash3x64(11, str), murmurHash3x64(11, part));
+    }
+  }
+
+  // The 4-byte path is the same as hashing the bytes of the value
+  for (uint32_t value : {0u, 1u, 12345u, 0xdeadbeefu, 0xffffffffu}) {
+    BOOST_CHECK_EQUAL(murmurHash3(11, value),
+                      murmurHash3(11, reinterpret_cast<const uint8_t*>(&value), sizeof(value)));
+  }
+  BOOST_CHECK_EQUAL(murmurHash3(11, 12345u), 0xae853880);
+
+  // Hashing with several seeds at once is the same as hashing with each seed
+  std::vector<uint32_t> seeds;
+  for (uint32_t i = 0; i < 20; i++) {
+    seeds.push_back(0x9747b28c * (i + 1));
+  }
+  for (size_t nSeeds : {1, 7, 8, 9, 20}) {
+    for (size_t size = 0; size <= bytes.size(); size++) {
+      std::vector<uint32_t> hashes(nSeeds);
+      murmurHash3(seeds.data(), nSeeds, bytes.data(), size, hashes.data());
+      for (size_t i = 0; i < nSeeds; i++) {
+        BOOST_CHECK_EQUAL(hashes[i], murmurHash3(seeds[i], bytes.data(), size));
+      }
+    }
+  }
+
+  uint64_t key = 0x0123456789abcdef;
+  BOOST_CHECK_EQUAL(hashKey(11, key, KeyWidth::BITS_64),
+                    murmurHash3(11, reinterpret_cast<const uint8_t*>(&key), sizeof(key)));
+  BOOST_CHECK_EQUAL(hashKey(11, 12345, KeyWidth::BITS_32), murmurHash3(11, 12345u));
+}
+
+BOOST_AUTO_TEST_CASE(Wyhash)
+{
+  // Reference values of wyhash final version 4 with the default secret
+  BOOST_CHECK_EQUAL(wyhash(0, std::string()), 0x93228a4de0eec5a2);
+  BOOST_CHECK_EQUAL(wyhash(1, std::string("a")), 0xc5bac3db178713c4);
+  BOOST_CHECK_EQUAL(wyhash(2, std::string("abc")), 0xa97f2f7b1d9b3314);
+  BOOST_CHECK_EQUAL(wyhash(3, std::string("message digest")), 0x786d1f1df3801df4);
+  BOOST_CHECK_EQUAL(wyhash(4, std::string("abcdefghijklmnopqrstuvwxyz")), 0xdca5a8138ad37c87);
+  BOOST_CHECK_EQUAL(wyhash(6, std::string("1234567890123456789012345678901234567890"
+                                          "1234567890123456789012345678901234567890")),
+                    0x6cc5eab49a92d617);
+
+  // The 8-byte path is the same as hashing the little endian bytes of the value
+  for (uint64_t value : {uint64_t(0), uint64_t(1), uint64_t(0x0123456789abcdef)}) {
+    uint8_t bytes[8];
+    for (size_t i = 0; i < sizeof(bytes); i++) {
+      bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+    BOOST_CHECK_EQUAL(wyhash(11, value), wyhash(11, bytes, sizeof(bytes)));
+    BOOST_CHECK_EQUAL(hashKey(11, value, KeyWidth::BITS_64, HashFamily::WYHASH),
+                      static_cast<uint32_t>(wyhash(11, value)));
+  }
+  // Keys of both widths are hashed as 64-bit values
+  BOOST_CHECK_EQUAL(hashKey(11, 12345, KeyWidth::BITS_32, HashFamily::WYHASH),
+                    hashKey(11, 12345, KeyWidth::BITS_64, HashFamily::WYHASH));
+}
+
+BOOST_AUTO_TEST_CASE(MurmurHash3x64)
+{
+  // Reference values of MurmurHash3_x64_128 (first 64 bits)
+  BOOST_CHECK_EQUAL(murmurHash3x64(0, ""), 0);
+  BOOST_CHECK_EQUAL(murmurHash3x64(0, "The quick brown fox jumps over the lazy dog"),
+                    0xe34bbc7bbc071b6cULL);
+  BOOST_CHECK_NE(murmurHash3x64(1, "The quick brown fox jumps over the lazy dog"),
+                 0xe34bbc7bbc071b6cULL);
+}
+
+BOOST_AUTO_TEST_CASE(Compression)
+{
+  std::vector<CompressionScheme> available = {CompressionScheme::NONE,
+                                              CompressionScheme::ZLIB,
+                                              CompressionScheme::GZIP};
+  std::vector<CompressionScheme> unavailable;
+
+#ifdef PSYNC_HAVE_BZIP2
+  available.push_back(CompressionScheme::BZIP2);
+#else
+  unavailable.push_back(CompressionScheme::BZIP2);
+#endif
+
+#ifdef PSYNC_HAVE_LZMA
+  available.push_back(CompressionScheme::LZMA);
+#else
+  unavailable.push_back(CompressionScheme::LZMA);
+#endif
+
+#ifdef PSYNC_HAVE_ZSTD
+  available.push_back(CompressionScheme::ZSTD);
+#else
+  unavailable.push_back(CompressionScheme::ZSTD);
+#endif
+
+  std::vector<uint8_t> uncompressed(1000);
+  for (size_t i = 0; i < uncompressed.size(); i++) {
+    uncompressed[i] = i % 7;
+  }
+
+  for (const auto& scheme : available) {
+    auto compressed = compress(scheme, uncompressed.data(), uncompressed.size());
+    auto decompressed = decompress(scheme, compressed->data(), compressed->size());
+    BOOST_CHECK_EQUAL_COLLECTIONS(decompressed->begin(), decompressed->end(),
+                                  uncompressed.begin(), uncompressed.end());
+  }
+
+  for (const auto& scheme : unavailable) {
+    BOOST_CHECK_THROW(compress(scheme, uncompressed.data(), uncompressed.size()), CompressionError);
+    BOOST_CHECK_THROW(decompress(scheme, uncompressed.data(), uncompressed.size()), CompressionError);
+  }
+
+  BOOST_CHECK_THROW(compress(static_cast<CompressionScheme>(200),
+                             uncompressed.data(), uncompressed.size()), CompressionError);
+  BOOST_CHECK_THROW(decompress(CompressionScheme::ZLIB,
+                               uncompressed.data(), uncompressed.size()), CompressionError);
+}
+
+BOOST_AUTO_TEST_CASE(StreamingDecompression)
+{
+  // Larger than a chunk, read in steps that do not divide it
+  std::vector<uint8_t> uncompressed(3 * DecompressingReader::CHUNK_SIZE + 5);
+  for (size_t i = 0; i < uncompressed.size(); i++) {
+    uncompressed[i] = i % 251;
+  }
+
+  for (auto scheme : {CompressionScheme::NONE, CompressionScheme::ZLIB}) {
+    auto compressed = compress(scheme, uncompressed.data(), uncompressed.size());
+    DecompressingReader reader(scheme, compressed->data(), compressed->size());
+    std::vector<uint8_t> decompressed;
+    while (reader.fill(7)) {
+      decompressed.insert(decompressed.end(), reader.pos(), reader.pos() + 7);
+      reader.advance(reader.pos() + 7);
+    }
+    decompressed.insert(decompressed.end(), reader.pos(), reader.end());
+    reader.advance(reader.end());
+    BOOST_CHECK(!reader.fill(1));
+    BOOST_CHECK_EQUAL_COLLECTIONS(decompressed.begin(), decompressed.end(),
+                                  uncompressed.begin(), uncompressed.end());
+
+    DecompressingReader skipped(scheme, compressed->data(), compressed->size());
+    BOOST_CHECK_EQUAL(skipped.skipAll(), uncompressed.size());
+  }
+
+  // Uncompressed buffers are read in place
+  DecompressingReader reader(CompressionScheme::NONE,
+                             uncompressed.data(), uncompressed.size());
+  BOOST_CHECK(reader.fill(uncompressed.size()));
+  BOOST_CHECK(reader.pos() == uncompressed.data());
+
+  DecompressingReader corrupt(CompressionScheme::ZLIB,
+                              uncompressed.data(), uncompressed.size());
+  BOOST_CHECK_THROW(corrupt.fill(1), CompressionError);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // namespace psync
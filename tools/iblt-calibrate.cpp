@@ -0,0 +1,125 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014-2019,  The University of Memphis
+ *
+ * This file is part of PSync.
+ * See AUTHORS.md for complete list of PSync authors and contributors.
+ *
+ * PSync is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU Lesser General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * PSync is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along with
+ * PSync, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <PSync/detail/iblt.hpp>
+
+#include <iostream>
+#include <random>
+#include <string>
+
+/**
+ * @brief Estimate how often the difference of two IBFs fails to decode
+ *
+ * Decodes trials random differences of each size, as the producers do
+ * (see IBLT::decodeDifference), and returns the fraction that failed.
+ */
+static double
+estimateFailureRate(size_t expectedNumEntries, size_t nDiff, int trials,
+                    const psync::IbltParameters& parameters, std::mt19937_64& rng)
+{
+  std::uniform_int_distribution<uint32_t> keys;
+  psync::DecodeScratch scratch;
+  std::vector<uint64_t> positive, negative;
+
+  int nFailed = 0;
+  for (int trial = 0; trial < trials; trial++) {
+    psync::IBLT own(expectedNumEntries, psync::CompressionScheme::NONE,
+                    psync::KeyWidth::DEFAULT, parameters);
+    psync::IBLT other(expectedNumEntries, psync::CompressionScheme::NONE,
+                      psync::KeyWidth::DEFAULT, parameters);
+    // Half of the difference on each side
+    for (size_t i = 0; i < nDiff; i++) {
+      (i % 2 == 0 ? own : other).insert(keys(rng));
+    }
+    if (own.decodeDifference(other, scratch, positive, negative) !=
+        psync::DecodeResult::SUCCESS) {
+      ++nFailed;
+    }
+  }
+  return static_cast<double>(nFailed) / trials;
+}
+
+int
+main(int argc, char* argv[])
+{
+  if (argc > 5) {
+    std::cout << "usage: " << argv[0] << " [trials] [number-of-hashes] "
+              << "[overprovision-factor] [target-failure-rate]" << std::endl;
+    return 1;
+  }
+
+  int trials = 1000;
+  psync::IbltParameters parameters;
+  double targetFailureRate = 0.01;
+  try {
+    if (argc > 1) {
+      trials = std::stoi(argv[1]);
+    }
+    if (argc > 2) {
+      parameters.nHash = static_cast<uint8_t>(std::stoi(argv[2]));
+    }
+    if (argc > 3) {
+      parameters.overprovisionFactor = std::stod(argv[3]);
+    }
+    if (argc > 4) {
+      targetFailureRate = std::stod(argv[4]);
+    }
+    // Throws if the parameters are invalid
+    psync::IBLT(1, psync::CompressionScheme::NONE, psync::KeyWidth::DEFAULT, parameters);
+  }
+  catch (const std::exception& e) {
+    std::cerr << "Invalid arguments: " << e.what() << std::endl;
+    return 1;
+  }
+
+  // Fixed seed, so that runs with the same arguments give the same curves
+  std::mt19937_64 rng(1);
+
+  // Failure rate curves, one per table size
+  std::cout << "expected\tcells\tdiff\tfailure" << std::endl;
+  std::vector<std::pair<size_t, size_t>> maxDiffs;
+  for (size_t expectedNumEntries = 16; expectedNumEntries <= 1024; expectedNumEntries *= 2) {
+    size_t nCells = psync::IBLT(expectedNumEntries, psync::CompressionScheme::NONE,
+                                psync::KeyWidth::DEFAULT, parameters).getNumCells();
+    size_t maxDiff = 0;
+    bool isWithinTarget = true;
+    for (size_t eighths = 1; eighths <= 12; eighths++) {
+      size_t nDiff = expectedNumEntries * eighths / 8;
+      double failureRate = estimateFailureRate(expectedNumEntries, nDiff, trials,
+                                               parameters, rng);
+      // Largest difference up to which all sizes are within the target
+      isWithinTarget = isWithinTarget && failureRate <= targetFailureRate;
+      if (isWithinTarget) {
+        maxDiff = nDiff;
+      }
+      std::cout << expectedNumEntries << "\t" << nCells << "\t" << nDiff << "\t"
+                << failureRate << std::endl;
+    }
+    maxDiffs.emplace_back(expectedNumEntries, maxDiff);
+  }
+
+  // Producers decode differences up to expectedNumEntries / 2 (the threshold),
+  // compare it with how large a difference decodes within the target failure rate
+  std::cout << std::endl
+            << "expected\tthreshold\tmax-diff(failure<=" << targetFailureRate << ")" << std::endl;
+  for (const auto& maxDiff : maxDiffs) {
+    std::cout << maxDiff.first << "\t" << maxDiff.first / 2 << "\t" << maxDiff.second << std::endl;
+  }
+  return 0;
+}